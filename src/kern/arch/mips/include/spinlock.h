@@ -46,6 +46,11 @@ SPINLOCK_INLINE
 spinlock_data_t spinlock_data_get(volatile spinlock_data_t *sd);
 SPINLOCK_INLINE
 spinlock_data_t spinlock_data_testandset(volatile spinlock_data_t *sd);
+SPINLOCK_INLINE
+spinlock_data_t spinlock_data_fetchandinc(volatile spinlock_data_t *sd);
+SPINLOCK_INLINE
+bool spinlock_data_cas(volatile spinlock_data_t *sd,
+		       spinlock_data_t old, spinlock_data_t new);
 
 ////////////////////////////////////////////////////////////
 
@@ -119,4 +124,58 @@ spinlock_data_testandset(volatile spinlock_data_t *sd)
 }
 
 
+/*
+ * Atomically add one to a spinlock_data_t and return the old value,
+ * for ticket locks. Retries until the SC succeeds.
+ */
+SPINLOCK_INLINE
+spinlock_data_t
+spinlock_data_fetchandinc(volatile spinlock_data_t *sd)
+{
+	spinlock_data_t x;
+	spinlock_data_t y;
+
+	do {
+		__asm volatile(
+			".set push;"		/* save assembler mode */
+			".set mips32;"		/* allow MIPS32 instructions */
+			".set volatile;"	/* avoid unwanted optimization */
+			"ll %0, 0(%2);"		/*   x = *sd */
+			"addiu %1, %0, 1;"	/*   y = x + 1 */
+			"sc %1, 0(%2);"		/*   *sd = y; y = success? */
+			".set pop"		/* restore assembler mode */
+			: "=&r" (x), "=&r" (y) : "r" (sd));
+	} while (y == 0);
+	return x;
+}
+
+/*
+ * Compare-and-swap a spinlock_data_t: if it holds OLD, replace that
+ * with NEW and return true; otherwise return false. May also fail
+ * spuriously if the SC does.
+ */
+SPINLOCK_INLINE
+bool
+spinlock_data_cas(volatile spinlock_data_t *sd,
+		  spinlock_data_t old, spinlock_data_t new)
+{
+	spinlock_data_t x;
+	spinlock_data_t y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		".set noreorder;"	/* we fill the delay slot */
+		"ll %0, 0(%3);"		/*   x = *sd */
+		"bne %0, %2, 1f;"	/*   if (x != old) fail */
+		" li %1, 0;"		/*   (delay slot) y = 0 */
+		"move %1, %4;"		/*   y = new */
+		"sc %1, 0(%3);"		/*   *sd = y; y = success? */
+		"1:"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (old), "r" (sd), "r" (new));
+	return y != 0;
+}
+
 #endif /* _MIPS_SPINLOCK_H_ */
@@ -114,13 +114,17 @@ paddr_t ram_getfirstfree(void);
  * TLB shootdown bits.
  *
  * We'll take up to 16 invalidations before just flushing the whole TLB.
+ *
+ * The paging VM shoots down one page of one address space at a time
+ * and waits on ts_done until the target cpu has dropped it.
  */
 
+struct semaphore;
+
 struct tlbshootdown {
-	/*
-	 * Change this to what you need for your VM design.
-	 */
-	int ts_placeholder;
+	vaddr_t ts_vaddr;		/* page to invalidate... */
+	unsigned ts_asid;		/* ...in this address space */
+	struct semaphore *ts_done;	/* V'd once it's gone */
 };
 
 #define TLBSHOOTDOWN_MAX 16
@@ -37,6 +37,7 @@
 #include <syscall.h>
 #include "opt-syscalls.h"
 #include "opt-waitpid.h"
+#include "opt-paging.h"
 
 
 /*
@@ -155,6 +156,38 @@ syscall(struct trapframe *tf)
 	  	case SYS_waitpid:
 	  	  err = sys_waitpid((pid_t)tf->tf_a0);
 	  	  break;
+#endif
+#if OPT_PAGING
+	    case SYS_sbrk:
+		err = sys_sbrk((intptr_t)tf->tf_a0, &retval);
+		break;
+
+	    case SYS_mmap:
+		err = sys_mmap((userptr_t)tf->tf_a0, (size_t)tf->tf_a1,
+			       (int)tf->tf_a2, (int)tf->tf_a3,
+			       (userptr_t)(tf->tf_sp + 16), &retval);
+		break;
+
+	    case SYS_munmap:
+		err = sys_munmap((userptr_t)tf->tf_a0, (size_t)tf->tf_a1);
+		break;
+
+	    case SYS_fsync:
+		err = sys_fsync((int)tf->tf_a0);
+		break;
+
+	    case SYS_vmstat:
+		err = sys_vmstat((userptr_t)tf->tf_a0);
+		break;
+
+	    case SYS_getrlimit:
+		err = sys_getrlimit((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_setrlimit:
+		err = sys_setrlimit((int)tf->tf_a0,
+				    (const_userptr_t)tf->tf_a1);
+		break;
 #endif
 	    default:
 		kprintf("Unknown syscall %d\n", callno);
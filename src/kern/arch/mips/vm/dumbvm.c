@@ -143,7 +143,8 @@ getfreeppages(unsigned long npages) {
   spinlock_acquire(&checkmem_lock);
   for (i=0, found=first=-1; i < nRamFrames; i++) {
     if (freeRamFrames[i]) {
-      if (i==0 || !freeRamFrames[i]) {
+      /* a run starts where the previous frame is not free */
+      if (i==0 || !freeRamFrames[i-1]) {
         first = i;
       }
       if (i - first + 1 >= np) {
@@ -576,6 +577,10 @@ void memstats(void) {
   //kprintf("Operation took %llu.%09lu seconds\n", (unsigned long long) duration.tv_sec, (unsigned long) duration.tv_nsec);
 }
 
+void tlbstats(void) {
+  kprintf("Enable option 'paging' in Kernel Configuration to use this functionality.\n");
+}
+
 #else /* OLD MANAGEMENT WITHOUT FREE */
 
 void
@@ -943,4 +948,8 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 void memstats(void) {
   kprintf("Enable option 'notsodumb' in Kernel Configuration to use this functionality.\n");
 }
+
+void tlbstats(void) {
+  kprintf("Enable option 'paging' in Kernel Configuration to use this functionality.\n");
+}
 #endif
\ No newline at end of file
@@ -0,0 +1,303 @@
+/*
+ * MIPS TLB management for the paging VM system.
+ *
+ * The TLB is refilled in software from vm_fault. Victims are chosen
+ * round-robin with a per-cpu cursor, so every slot gets reused in
+ * turn and a process whose working set is larger than the TLB keeps
+ * running instead of failing once all 64 slots are valid.
+ *
+ * User entries are tagged with an address space ID, so a context
+ * switch only has to load the new process's ASID into EntryHi instead
+ * of invalidating the whole TLB. ASIDs are handed out per cpu from a
+ * counter whose upper bits count generations: when the 63 usable
+ * ASIDs run out the TLB is flushed once and a new generation starts,
+ * which invalidates every ASID handed out before. An address space
+ * keeps its ASID as long as it belongs to the current generation of
+ * the cpu it is running on; after moving to another cpu it gets a new
+ * one, since the entries it left behind may be out of date by the
+ * time it comes back. ASID 0 is never handed out.
+ *
+ * Each cpu counts its own misses, fast refills (misses satisfied
+ * straight from the page table), evictions, full flushes, ASID
+ * rollovers and entries preloaded by fault-around (see vm_fault); the
+ * tlbstats menu command prints them.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <synch.h>
+#include <mips/tlb.h>
+#include <addrspace.h>
+#include <vm.h>
+
+#define ASID_MASK	(NUM_ASID - 1)
+
+/* Signalled by the target of a shootdown; see vm_tlbinvalidate. */
+static struct semaphore *tlb_shootdown_sem;
+
+/*
+ * Load ASID into the PID field of EntryHi, which is what the MMU
+ * matches TLB entries against. tlb_read, tlb_write and tlb_probe all
+ * overwrite EntryHi, so anything that uses them must leave the
+ * current ASID in place again before turning interrupts back on.
+ */
+#define SET_ENTRYHI(x) __asm volatile("mtc0 %0,$10" :: "r" (x))
+
+static
+void
+tlb_setasid(unsigned asid)
+{
+	SET_ENTRYHI(asid << TLBHI_PIDSHIFT);
+}
+
+/*
+ * Drop the entry for VADDR in address space ASID from this cpu's TLB,
+ * if there is one.
+ */
+static
+void
+tlb_invalidate(vaddr_t vaddr, unsigned asid)
+{
+	int i, spl;
+
+	spl = splhigh();
+	i = tlb_probe(vaddr | (asid << TLBHI_PIDSHIFT), 0);
+	if (i >= 0) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	tlb_setasid(curcpu->c_asid);
+	splx(spl);
+}
+
+void
+vm_tlbbootstrap(void)
+{
+	tlb_shootdown_sem = sem_create("tlbshootdown", 0);
+	if (tlb_shootdown_sem == NULL) {
+		panic("vm: cannot create TLB shootdown semaphore\n");
+	}
+}
+
+void
+vm_tlbload(vaddr_t vaddr, paddr_t paddr, bool writeable, bool refill)
+{
+	int i, spl;
+	uint32_t ehi, elo, oehi, oelo;
+
+	KASSERT((vaddr & PAGE_FRAME) == vaddr);
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+
+	ehi = vaddr | (curcpu->c_asid << TLBHI_PIDSHIFT);
+	elo = paddr | TLBLO_VALID;
+	if (writeable) {
+		elo |= TLBLO_DIRTY;
+	}
+
+	/* Disable interrupts on this CPU while frobbing the TLB. */
+	spl = splhigh();
+
+	/*
+	 * If the page is already in the TLB (read-only, and we are
+	 * upgrading it after a write fault) replace it in place: two
+	 * entries for the same page are not allowed.
+	 */
+	i = tlb_probe(ehi, 0);
+	if (i < 0) {
+		i = curcpu->c_tlb_victim;
+		curcpu->c_tlb_victim = (i + 1) % NUM_TLB;
+
+		tlb_read(&oehi, &oelo, i);
+		if (oelo & TLBLO_VALID) {
+			curcpu->c_tlb_evictions++;
+		}
+		curcpu->c_tlb_misses++;
+		if (refill) {
+			curcpu->c_tlb_refills++;
+		}
+	}
+
+	DEBUG(DB_VM, "vm: 0x%x -> 0x%x (slot %d)\n", vaddr, paddr, i);
+	/* This also puts our ASID back after tlb_read. */
+	tlb_write(ehi, elo, i);
+
+	splx(spl);
+}
+
+bool
+vm_tlbpreload(vaddr_t vaddr, paddr_t paddr, bool writeable)
+{
+	int i, spl;
+	uint32_t ehi, elo;
+
+	KASSERT((vaddr & PAGE_FRAME) == vaddr);
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+
+	ehi = vaddr | (curcpu->c_asid << TLBHI_PIDSHIFT);
+	elo = paddr | TLBLO_VALID;
+	if (writeable) {
+		elo |= TLBLO_DIRTY;
+	}
+
+	spl = splhigh();
+
+	/* Leave entries that are already there alone. */
+	if (tlb_probe(ehi, 0) >= 0) {
+		tlb_setasid(curcpu->c_asid);
+		splx(spl);
+		return false;
+	}
+
+	i = curcpu->c_tlb_victim;
+	curcpu->c_tlb_victim = (i + 1) % NUM_TLB;
+	curcpu->c_tlb_preloads++;
+	tlb_write(ehi, elo, i);
+
+	splx(spl);
+	return true;
+}
+
+void
+vm_tlbflush(void)
+{
+	int i, spl;
+
+	/* Disable interrupts on this CPU while frobbing the TLB. */
+	spl = splhigh();
+
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	curcpu->c_tlb_victim = 0;
+	curcpu->c_tlb_flushes++;
+	tlb_setasid(curcpu->c_asid);
+
+	splx(spl);
+}
+
+/*
+ * Hand out the next ASID on cpu C, starting a new generation (and
+ * flushing the TLB) if they have all been used. Interrupts must be
+ * off.
+ */
+static
+uint32_t
+vm_newasid(struct cpu *c)
+{
+	uint32_t asid;
+
+	asid = c->c_asid_cache + 1;
+	if ((asid & ASID_MASK) == 0) {
+		vm_tlbflush();
+		c->c_asid_rollovers++;
+		if (asid == 0) {
+			/* generation counter wrapped; skip generation 0 */
+			asid = NUM_ASID;
+		}
+		asid++;
+	}
+	c->c_asid_cache = asid;
+	return asid;
+}
+
+void
+vm_tlbactivate(struct addrspace *as)
+{
+	struct cpu *c;
+	int spl;
+
+	spl = splhigh();
+	c = curcpu;
+
+	if (as->as_asid == 0 || as->as_asidcpu != c->c_number ||
+	    ((as->as_asid ^ c->c_asid_cache) & ~(uint32_t)ASID_MASK) != 0) {
+		as->as_asid = vm_newasid(c);
+		as->as_asidcpu = c->c_number;
+	}
+	c->c_asid = as->as_asid & ASID_MASK;
+	tlb_setasid(c->c_asid);
+
+	splx(spl);
+}
+
+/*
+ * Make sure no cpu has a translation for VADDR in AS. Only the cpu AS
+ * got its current ASID from can have one; entries on other cpus carry
+ * ASIDs AS will never use again. Callers hold the VM lock, which also
+ * serializes use of tlb_shootdown_sem.
+ */
+void
+vm_tlbinvalidate(struct addrspace *as, vaddr_t vaddr)
+{
+	struct tlbshootdown ts;
+	struct cpu *target;
+	int spl;
+
+	KASSERT(vm_lock_do_i_hold());
+
+	spl = splhigh();
+	if (as->as_asid == 0) {
+		/* Not loaded anywhere since its last ASID was retired. */
+		splx(spl);
+		return;
+	}
+	ts.ts_vaddr = vaddr;
+	ts.ts_asid = as->as_asid & ASID_MASK;
+	ts.ts_done = tlb_shootdown_sem;
+	target = cpu_get(as->as_asidcpu);
+	if (target == curcpu->c_self) {
+		tlb_invalidate(ts.ts_vaddr, ts.ts_asid);
+		splx(spl);
+		return;
+	}
+	splx(spl);
+
+	ipi_tlbshootdown(target, &ts);
+	P(tlb_shootdown_sem);
+}
+
+void
+vm_tlbshootdown(const struct tlbshootdown *ts)
+{
+	tlb_invalidate(ts->ts_vaddr, ts->ts_asid);
+	V(ts->ts_done);
+}
+
+void
+tlbstats(void)
+{
+	unsigned i, n;
+	unsigned misses, refills, evictions, flushes, rollovers, preloads;
+	struct cpu *c;
+
+	misses = refills = evictions = flushes = rollovers = preloads = 0;
+
+	kprintf("* TLB Status *\n");
+	n = cpu_count();
+	for (i=0; i<n; i++) {
+		c = cpu_get(i);
+		kprintf(" > cpu%u: %u misses, %u refills, %u evictions, "
+			"%u flushes, %u ASID rollovers, %u preloads\n",
+			c->c_number, c->c_tlb_misses, c->c_tlb_refills,
+			c->c_tlb_evictions, c->c_tlb_flushes,
+			c->c_asid_rollovers, c->c_tlb_preloads);
+		misses += c->c_tlb_misses;
+		refills += c->c_tlb_refills;
+		evictions += c->c_tlb_evictions;
+		flushes += c->c_tlb_flushes;
+		rollovers += c->c_asid_rollovers;
+		preloads += c->c_tlb_preloads;
+	}
+
+	kprintf(" > Total: %u misses, %u refills, %u evictions, "
+		"%u flushes, %u ASID rollovers, %u preloads\n", misses,
+		refills, evictions, flushes, rollovers, preloads);
+	if (misses > 0) {
+		kprintf(" > %u%% of misses refilled from the page table, "
+			"%u%% evicted a valid entry\n",
+			(unsigned)(100ULL * refills / misses),
+			(unsigned)(100ULL * evictions / misses));
+	}
+}
@@ -53,6 +53,7 @@
 #include <platform/bus.h>
 #include <vfs.h>
 #include <emufs.h>
+#include <textcache.h>
 #include "autoconf.h"
 
 /* Register offsets */
@@ -269,6 +270,9 @@ int
 emu_doread(struct emu_softc *sc, uint32_t handle, uint32_t len,
 	   uint32_t op, struct uio *uio)
 {
+	char *buf;
+	uint32_t got;
+	off_t newoffset;
 	int result;
 
 	KASSERT(uio->uio_rw == UIO_READ);
@@ -278,6 +282,19 @@ emu_doread(struct emu_softc *sc, uint32_t handle, uint32_t len,
 		return 0;
 	}
 
+	/*
+	 * Copying out to user memory can fault, and the fault may need
+	 * to read a page from this same device, so it can't be done
+	 * holding e_lock. Bounce it through a buffer of our own.
+	 */
+	buf = NULL;
+	if (uio->uio_segflg != UIO_SYSSPACE) {
+		buf = kmalloc(len);
+		if (buf == NULL) {
+			return ENOMEM;
+		}
+	}
+
 	lock_acquire(sc->e_lock);
 
 	emu_wreg(sc, REG_HANDLE, handle);
@@ -290,12 +307,25 @@ emu_doread(struct emu_softc *sc, uint32_t handle, uint32_t len,
 	}
 
 	membar_load_load();
-	result = uiomove(sc->e_iobuf, emu_rreg(sc, REG_IOLEN), uio);
-
-	uio->uio_offset = emu_rreg(sc, REG_OFFSET);
+	got = emu_rreg(sc, REG_IOLEN);
+	newoffset = emu_rreg(sc, REG_OFFSET);
+	if (buf == NULL) {
+		result = uiomove(sc->e_iobuf, got, uio);
+		uio->uio_offset = newoffset;
+	}
+	else {
+		memcpy(buf, sc->e_iobuf, got);
+	}
 
  out:
 	lock_release(sc->e_lock);
+	if (buf != NULL) {
+		if (result == 0) {
+			result = uiomove(buf, got, uio);
+			uio->uio_offset = newoffset;
+		}
+		kfree(buf);
+	}
 	return result;
 }
 
@@ -329,6 +359,8 @@ int
 emu_write(struct emu_softc *sc, uint32_t handle, uint32_t len,
 	  struct uio *uio)
 {
+	char *buf;
+	off_t offset;
 	int result;
 
 	KASSERT(uio->uio_rw == UIO_WRITE);
@@ -337,13 +369,35 @@ emu_write(struct emu_softc *sc, uint32_t handle, uint32_t len,
 		return EFBIG;
 	}
 
+	/* As in emu_doread, copy in user memory before taking e_lock. */
+	buf = NULL;
+	if (uio->uio_segflg != UIO_SYSSPACE) {
+		buf = kmalloc(len);
+		if (buf == NULL) {
+			return ENOMEM;
+		}
+		offset = uio->uio_offset;
+		result = uiomove(buf, len, uio);
+		if (result) {
+			kfree(buf);
+			return result;
+		}
+	}
+
 	lock_acquire(sc->e_lock);
 
 	emu_wreg(sc, REG_HANDLE, handle);
 	emu_wreg(sc, REG_IOLEN, len);
-	emu_wreg(sc, REG_OFFSET, uio->uio_offset);
 
-	result = uiomove(sc->e_iobuf, len, uio);
+	if (buf == NULL) {
+		emu_wreg(sc, REG_OFFSET, uio->uio_offset);
+		result = uiomove(sc->e_iobuf, len, uio);
+	}
+	else {
+		emu_wreg(sc, REG_OFFSET, offset);
+		memcpy(sc->e_iobuf, buf, len);
+		result = 0;
+	}
 	membar_store_store();
 	if (result) {
 		goto out;
@@ -354,6 +408,9 @@ emu_write(struct emu_softc *sc, uint32_t handle, uint32_t len,
 
  out:
 	lock_release(sc->e_lock);
+	if (buf != NULL) {
+		kfree(buf);
+	}
 	return result;
 }
 
@@ -473,12 +530,10 @@ emufs_reclaim(struct vnode *v)
 	int result;
 
 	/*
-	 * Need all of these locks, e_lock to protect the device,
-	 * vfs_biglock to protect the fs-related material, and
-	 * vn_countlock for the reference count.
+	 * Need both of these locks, e_lock to protect the device and
+	 * the vnode table, and vn_countlock for the reference count.
 	 */
 
-	vfs_biglock_acquire();
 	lock_acquire(ef->ef_emu->e_lock);
 	spinlock_acquire(&ev->ev_v.vn_countlock);
 
@@ -488,7 +543,6 @@ emufs_reclaim(struct vnode *v)
 
 		spinlock_release(&ev->ev_v.vn_countlock);
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		return EBUSY;
 	}
 	KASSERT(ev->ev_v.vn_refcount == 1);
@@ -503,7 +557,6 @@ emufs_reclaim(struct vnode *v)
 	result = emu_close(ev->ev_emu, ev->ev_handle);
 	if (result) {
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -527,7 +580,6 @@ emufs_reclaim(struct vnode *v)
 	vnode_cleanup(&ev->ev_v);
 
 	lock_release(ef->ef_emu->e_lock);
-	vfs_biglock_release();
 
 	kfree(ev);
 	return 0;
@@ -599,7 +651,7 @@ emufs_write(struct vnode *v, struct uio *uio)
 	struct emufs_vnode *ev = v->vn_data;
 	uint32_t amt;
 	size_t oldresid;
-	int result;
+	int result = 0;
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
@@ -613,7 +665,7 @@ emufs_write(struct vnode *v, struct uio *uio)
 
 		result = emu_write(ev->ev_emu, ev->ev_handle, amt, uio);
 		if (result) {
-			return result;
+			break;
 		}
 
 		if (uio->uio_resid == oldresid) {
@@ -622,7 +674,8 @@ emufs_write(struct vnode *v, struct uio *uio)
 		}
 	}
 
-	return 0;
+	textcache_invalidate(v);
+	return result;
 }
 
 /*
@@ -725,7 +778,11 @@ int
 emufs_truncate(struct vnode *v, off_t len)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	return emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	int result;
+
+	result = emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	textcache_invalidate(v);
+	return result;
 }
 
 /*
@@ -845,13 +902,22 @@ emufs_namefile(struct vnode *v, struct uio *uio)
 
 /*
  * VOP_MMAP
+ *
+ * Files are paged through emufs_read and emufs_write like any other
+ * file, so all we need to check is the offset.
  */
 static
 int
-emufs_mmap(struct vnode *v)
+emufs_mmap(struct vnode *v, off_t offset, size_t len, int prot)
 {
 	(void)v;
-	return ENOSYS;
+	(void)len;
+	(void)prot;
+
+	if (offset < 0) {
+		return EINVAL;
+	}
+	return 0;
 }
 
 //////////////////////////////
@@ -1121,7 +1187,7 @@ static const struct vnode_ops emufs_dirops = {
 	.vop_gettype = emufs_dir_gettype,
 	.vop_isseekable = emufs_isseekable,
 	.vop_fsync = emufs_void_op_isdir,
-	.vop_mmap = emufs_void_op_isdir,
+	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = emufs_truncate_isdir,
 	.vop_namefile = emufs_namefile,
 
@@ -1150,7 +1216,6 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 	unsigned i, num;
 	int result;
 
-	vfs_biglock_acquire();
 	lock_acquire(ef->ef_emu->e_lock);
 
 	num = vnodearray_num(ef->ef_vnodes);
@@ -1163,7 +1228,6 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 			VOP_INCREF(&ev->ev_v);
 
 			lock_release(ef->ef_emu->e_lock);
-			vfs_biglock_release();
 			*ret = ev;
 			return 0;
 		}
@@ -1184,7 +1248,6 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 			    &ef->ef_fs, ev);
 	if (result) {
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		kfree(ev);
 		return result;
 	}
@@ -1194,13 +1257,11 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 		/* note: vnode_cleanup undoes vnode_init - it does not kfree */
 		vnode_cleanup(&ev->ev_v);
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		kfree(ev);
 		return result;
 	}
 
 	lock_release(ef->ef_emu->e_lock);
-	vfs_biglock_release();
 
 	*ret = ev;
 	return 0;
@@ -35,6 +35,7 @@
 #include <types.h>
 #include <lib.h>
 #include <bitmap.h>
+#include <synch.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
@@ -45,7 +46,10 @@ static
 int
 sfs_clearblock(struct sfs_fs *sfs, daddr_t block)
 {
-	/* static -> automatically initialized to zero */
+	/*
+	 * static -> automatically initialized to zero. It is only
+	 * ever read, so concurrent callers can share it.
+	 */
 	static char zeros[SFS_BLOCKSIZE];
 
 	return sfs_writeblock(sfs, block, zeros, SFS_BLOCKSIZE);
@@ -59,8 +63,10 @@ sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock)
 {
 	int result;
 
+	lock_acquire(sfs->sfs_freemaplock);
 	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
 	if (result) {
+		lock_release(sfs->sfs_freemaplock);
 		return result;
 	}
 	sfs->sfs_freemapdirty = true;
@@ -69,11 +75,15 @@ sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock)
 		panic("sfs: %s: balloc: invalid block %u\n",
 		      sfs->sfs_sb.sb_volname, *diskblock);
 	}
+	lock_release(sfs->sfs_freemaplock);
 
-	/* Clear block before returning it */
+	/*
+	 * Clear block before returning it. The block is already ours,
+	 * so there is no need to hold up other allocations meanwhile.
+	 */
 	result = sfs_clearblock(sfs, *diskblock);
 	if (result) {
-		bitmap_unmark(sfs->sfs_freemap, *diskblock);
+		sfs_bfree(sfs, *diskblock);
 	}
 	return result;
 }
@@ -84,8 +94,10 @@ sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock)
 void
 sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock)
 {
+	lock_acquire(sfs->sfs_freemaplock);
 	bitmap_unmark(sfs->sfs_freemap, diskblock);
 	sfs->sfs_freemapdirty = true;
+	lock_release(sfs->sfs_freemaplock);
 }
 
 /*
@@ -94,10 +106,15 @@ sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock)
 int
 sfs_bused(struct sfs_fs *sfs, daddr_t diskblock)
 {
+	int ret;
+
 	if (diskblock >= sfs->sfs_sb.sb_nblocks) {
 		panic("sfs: %s: sfs_bused called on out of range block %u\n",
 		      sfs->sfs_sb.sb_volname, diskblock);
 	}
-	return bitmap_isset(sfs->sfs_freemap, diskblock);
+	lock_acquire(sfs->sfs_freemaplock);
+	ret = bitmap_isset(sfs->sfs_freemap, diskblock);
+	lock_release(sfs->sfs_freemaplock);
+	return ret;
 }
 
@@ -35,7 +35,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
-#include <vfs.h>
+#include <synch.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
@@ -54,9 +54,9 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	 *
 	 * Note: in real life (and when you've done the fs assignment)
 	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
+	 * not kmalloc it on every call.
 	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
+	uint32_t *idbuf;
 
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
 	daddr_t block;
@@ -64,10 +64,10 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	uint32_t idnum, idoff;
 	int result;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	KASSERT(SFS_DBPERIDB*sizeof(idbuf[0])==SFS_BLOCKSIZE);
 
-	/* Since we're using a static buffer, we'd better be locked. */
-	KASSERT(vfs_biglock_do_i_hold());
+	/* The block map lives in sv_i, so the vnode must be locked. */
+	KASSERT(lock_do_i_hold(sv->sv_lock));
 
 	/*
 	 * If the block we want is one of the direct blocks...
@@ -136,7 +136,13 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		*diskblock = 0;
 		return 0;
 	}
-	else if (idblock==0) {
+
+	idbuf = kmalloc(SFS_BLOCKSIZE);
+	if (idbuf == NULL) {
+		return ENOMEM;
+	}
+
+	if (idblock==0) {
 		/*
 		 * There's no indirect block allocated, but we need to
 		 * allocate a block whose number needs to be stored in
@@ -145,6 +151,7 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		 */
 		result = sfs_balloc(sfs, &idblock);
 		if (result) {
+			kfree(idbuf);
 			return result;
 		}
 
@@ -155,14 +162,15 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		sv->sv_dirty = true;
 
 		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
+		bzero(idbuf, SFS_BLOCKSIZE);
 	}
 	else {
 		/*
 		 * We already have an indirect block allocated; load it.
 		 */
-		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
+		result = sfs_readblock(sfs, idblock, idbuf, SFS_BLOCKSIZE);
 		if (result) {
+			kfree(idbuf);
 			return result;
 		}
 	}
@@ -174,6 +182,7 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	if (block==0 && doalloc) {
 		result = sfs_balloc(sfs, &block);
 		if (result) {
+			kfree(idbuf);
 			return result;
 		}
 
@@ -181,11 +190,13 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		idbuf[idoff] = block;
 
 		/* The indirect block is now dirty; write it back */
-		result = sfs_writeblock(sfs, idblock, idbuf, sizeof(idbuf));
+		result = sfs_writeblock(sfs, idblock, idbuf, SFS_BLOCKSIZE);
 		if (result) {
+			kfree(idbuf);
 			return result;
 		}
 	}
+	kfree(idbuf);
 
 	/* Hand back the result and return. */
 	if (block != 0 && !sfs_bused(sfs, block)) {
@@ -198,7 +209,8 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 }
 
 /*
- * Called for ftruncate() and from sfs_reclaim.
+ * Called for ftruncate() and from sfs_reclaim. The caller holds the
+ * vnode's lock.
  */
 int
 sfs_itrunc(struct sfs_vnode *sv, off_t len)
@@ -208,9 +220,9 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	 *
 	 * Note: in real life (and when you've done the fs assignment)
 	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
+	 * not kmalloc it on every call.
 	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
+	uint32_t *idbuf;
 
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
 
@@ -223,9 +235,8 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	int result;
 	int hasnonzero, iddirty;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
-
-	vfs_biglock_acquire();
+	KASSERT(SFS_DBPERIDB*sizeof(idbuf[0])==SFS_BLOCKSIZE);
+	KASSERT(lock_do_i_hold(sv->sv_lock));
 
 	/*
 	 * Go through the direct blocks. Discard any that are
@@ -252,10 +263,15 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	if (blocklen < highblock && idblock != 0) {
 		/* We're past the proposed EOF; may need to free stuff */
 
+		idbuf = kmalloc(SFS_BLOCKSIZE);
+		if (idbuf == NULL) {
+			return ENOMEM;
+		}
+
 		/* Read the indirect block */
-		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
+		result = sfs_readblock(sfs, idblock, idbuf, SFS_BLOCKSIZE);
 		if (result) {
-			vfs_biglock_release();
+			kfree(idbuf);
 			return result;
 		}
 
@@ -283,12 +299,13 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 		else if (iddirty) {
 			/* The indirect block is dirty; write it back */
 			result = sfs_writeblock(sfs, idblock, idbuf,
-						sizeof(idbuf));
+						SFS_BLOCKSIZE);
 			if (result) {
-				vfs_biglock_release();
+				kfree(idbuf);
 				return result;
 			}
 		}
+		kfree(idbuf);
 	}
 
 	/* Set the file size */
@@ -297,7 +314,6 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	/* Mark the inode dirty */
 	sv->sv_dirty = true;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -40,6 +40,7 @@
 #include <bitmap.h>
 #include <uio.h>
 #include <vfs.h>
+#include <synch.h>
 #include <device.h>
 #include <sfs.h>
 #include "sfsprivate.h"
@@ -107,19 +108,41 @@ sfs_freemapio(struct sfs_fs *sfs, enum uio_rw rw)
 
 /*
  * Sync routine for the vnode table.
+ *
+ * VOP_FSYNC takes each vnode's sv_lock, which comes before
+ * sfs_vnlock in the lock order, so take a referenced snapshot of the
+ * table and sync from that with the table unlocked.
  */
 static
 int
 sfs_sync_vnodes(struct sfs_fs *sfs)
 {
+	struct vnode **vs;
 	unsigned i, num;
 
-	/* Go over the array of loaded vnodes, syncing as we go. */
+	lock_acquire(sfs->sfs_vnlock);
 	num = vnodearray_num(sfs->sfs_vnodes);
+	if (num == 0) {
+		lock_release(sfs->sfs_vnlock);
+		return 0;
+	}
+	vs = kmalloc(num * sizeof(vs[0]));
+	if (vs == NULL) {
+		lock_release(sfs->sfs_vnlock);
+		return ENOMEM;
+	}
+	for (i=0; i<num; i++) {
+		vs[i] = vnodearray_get(sfs->sfs_vnodes, i);
+		VOP_INCREF(vs[i]);
+	}
+	lock_release(sfs->sfs_vnlock);
+
+	/* Go over the loaded vnodes, syncing as we go. */
 	for (i=0; i<num; i++) {
-		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
-		VOP_FSYNC(v);
+		VOP_FSYNC(vs[i]);
+		VOP_DECREF(vs[i]);
 	}
+	kfree(vs);
 	return 0;
 }
 
@@ -132,13 +155,16 @@ sfs_sync_freemap(struct sfs_fs *sfs)
 {
 	int result;
 
+	lock_acquire(sfs->sfs_freemaplock);
 	if (sfs->sfs_freemapdirty) {
 		result = sfs_freemapio(sfs, UIO_WRITE);
 		if (result) {
+			lock_release(sfs->sfs_freemaplock);
 			return result;
 		}
 		sfs->sfs_freemapdirty = false;
 	}
+	lock_release(sfs->sfs_freemaplock);
 
 	return 0;
 }
@@ -152,14 +178,17 @@ sfs_sync_superblock(struct sfs_fs *sfs)
 {
 	int result;
 
+	lock_acquire(sfs->sfs_freemaplock);
 	if (sfs->sfs_superdirty) {
 		result = sfs_writeblock(sfs, SFS_SUPER_BLOCK, &sfs->sfs_sb,
 					sizeof(sfs->sfs_sb));
 		if (result) {
+			lock_release(sfs->sfs_freemaplock);
 			return result;
 		}
 		sfs->sfs_superdirty = false;
 	}
+	lock_release(sfs->sfs_freemaplock);
 	return 0;
 }
 
@@ -174,8 +203,6 @@ sfs_sync(struct fs *fs)
 	struct sfs_fs *sfs;
 	int result;
 
-	vfs_biglock_acquire();
-
 	/*
 	 * Get the sfs_fs from the generic abstract fs.
 	 *
@@ -211,25 +238,21 @@ sfs_sync(struct fs *fs)
 	/* If any vnodes need to be written, write them. */
 	result = sfs_sync_vnodes(sfs);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	/* If the free block map needs to be written, write it. */
 	result = sfs_sync_freemap(sfs);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	/* If the superblock needs to be written, write it. */
 	result = sfs_sync_superblock(sfs);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -243,13 +266,9 @@ const char *
 sfs_getvolname(struct fs *fs)
 {
 	struct sfs_fs *sfs = fs->fs_data;
-	const char *ret;
 
-	vfs_biglock_acquire();
-	ret = sfs->sfs_sb.sb_volname;
-	vfs_biglock_release();
-
-	return ret;
+	/* The volume name never changes once mounted; no lock needed. */
+	return sfs->sfs_sb.sb_volname;
 }
 
 /*
@@ -263,6 +282,8 @@ sfs_fs_destroy(struct sfs_fs *sfs)
 		bitmap_destroy(sfs->sfs_freemap);
 	}
 	vnodearray_destroy(sfs->sfs_vnodes);
+	lock_destroy(sfs->sfs_vnlock);
+	lock_destroy(sfs->sfs_freemaplock);
 	KASSERT(sfs->sfs_device == NULL);
 	kfree(sfs);
 }
@@ -277,12 +298,17 @@ int
 sfs_unmount(struct fs *fs)
 {
 	struct sfs_fs *sfs = fs->fs_data;
+	unsigned num;
 
-	vfs_biglock_acquire();
-
-	/* Do we have any files open? If so, can't unmount. */
-	if (vnodearray_num(sfs->sfs_vnodes) > 0) {
-		vfs_biglock_release();
+	/*
+	 * Do we have any files open? If so, can't unmount. Nothing
+	 * new can be opened meanwhile: the VFS layer holds its device
+	 * table lock for writing, and that's the only way in.
+	 */
+	lock_acquire(sfs->sfs_vnlock);
+	num = vnodearray_num(sfs->sfs_vnodes);
+	lock_release(sfs->sfs_vnlock);
+	if (num > 0) {
 		return EBUSY;
 	}
 
@@ -297,7 +323,6 @@ sfs_unmount(struct fs *fs)
 	sfs_fs_destroy(sfs);
 
 	/* nothing else to do */
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -343,6 +368,12 @@ sfs_fs_create(void)
 	sfs->sfs_absfs.fs_data = sfs;
 	sfs->sfs_absfs.fs_ops = &sfs_fsops;
 
+	/* superblock and freemap lock */
+	sfs->sfs_freemaplock = lock_create("sfs_freemap");
+	if (sfs->sfs_freemaplock == NULL) {
+		goto cleanup_object;
+	}
+
 	/* superblock */
 	/* (ignore sfs_super, we'll read in over it shortly) */
 	sfs->sfs_superdirty = false;
@@ -351,9 +382,13 @@ sfs_fs_create(void)
 	sfs->sfs_device = NULL;
 
 	/* vnode table */
+	sfs->sfs_vnlock = lock_create("sfs_vnodes");
+	if (sfs->sfs_vnlock == NULL) {
+		goto cleanup_freemaplock;
+	}
 	sfs->sfs_vnodes = vnodearray_create();
 	if (sfs->sfs_vnodes == NULL) {
-		goto cleanup_object;
+		goto cleanup_vnlock;
 	}
 
 	/* freemap */
@@ -362,6 +397,10 @@ sfs_fs_create(void)
 
 	return sfs;
 
+cleanup_vnlock:
+	lock_destroy(sfs->sfs_vnlock);
+cleanup_freemaplock:
+	lock_destroy(sfs->sfs_freemaplock);
 cleanup_object:
 	kfree(sfs);
 fail:
@@ -388,8 +427,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	int result;
 	struct sfs_fs *sfs;
 
-	vfs_biglock_acquire();
-
 	/* We don't pass any options through mount */
 	(void)options;
 
@@ -402,7 +439,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	 * don't do that in sfs.)
 	 */
 	if (dev->d_blocksize != SFS_BLOCKSIZE) {
-		vfs_biglock_release();
 		kprintf("sfs: Cannot mount on device with blocksize %zu\n",
 			dev->d_blocksize);
 		return ENXIO;
@@ -410,7 +446,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 
 	sfs = sfs_fs_create();
 	if (sfs == NULL) {
-		vfs_biglock_release();
 		return ENOMEM;
 	}
 
@@ -423,7 +458,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	if (result) {
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -436,7 +470,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 			SFS_MAGIC);
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
-		vfs_biglock_release();
 		return EINVAL;
 	}
 
@@ -453,21 +486,18 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	if (sfs->sfs_freemap == NULL) {
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
-		vfs_biglock_release();
 		return ENOMEM;
 	}
 	result = sfs_freemapio(sfs, UIO_READ);
 	if (result) {
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
-		vfs_biglock_release();
 		return result;
 	}
 
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -36,6 +36,7 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <vfs.h>
+#include <synch.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
@@ -49,6 +50,8 @@ sfs_sync_inode(struct sfs_vnode *sv)
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
 	int result;
 
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
 	if (sv->sv_dirty) {
 		result = sfs_writeblock(sfs, sv->sv_ino, &sv->sv_i,
 					sizeof(sv->sv_i));
@@ -73,13 +76,15 @@ sfs_reclaim(struct vnode *v)
 	unsigned ix, i, num;
 	int result;
 
-	vfs_biglock_acquire();
-
 	/*
 	 * Make sure someone else hasn't picked up the vnode since the
-	 * decision was made to reclaim it. (You must also synchronize
-	 * this with sfs_loadvnode.)
+	 * decision was made to reclaim it. sfs_loadvnode only hands
+	 * out references while holding sfs_vnlock, so holding it here
+	 * closes that race. We keep it until the vnode is out of the
+	 * table, so nobody can load a stale copy of the inode from
+	 * disk before we've written ours back.
 	 */
+	lock_acquire(sfs->sfs_vnlock);
 	spinlock_acquire(&v->vn_countlock);
 	if (v->vn_refcount != 1) {
 
@@ -88,24 +93,33 @@ sfs_reclaim(struct vnode *v)
 		v->vn_refcount--;
 
 		spinlock_release(&v->vn_countlock);
-		vfs_biglock_release();
+		lock_release(sfs->sfs_vnlock);
 		return EBUSY;
 	}
 	spinlock_release(&v->vn_countlock);
 
+	/*
+	 * This is backwards from the usual lock order, but nobody
+	 * else has a reference, so nobody else can hold sv_lock and
+	 * this never waits.
+	 */
+	lock_acquire(sv->sv_lock);
+
 	/* If there are no on-disk references to the file either, erase it. */
 	if (sv->sv_i.sfi_linkcount == 0) {
 		result = sfs_itrunc(sv, 0);
 		if (result) {
-			vfs_biglock_release();
+			lock_release(sv->sv_lock);
+			lock_release(sfs->sfs_vnlock);
 			return result;
 		}
 	}
 
 	/* Sync the inode to disk */
 	result = sfs_sync_inode(sv);
+	lock_release(sv->sv_lock);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
 
@@ -131,11 +145,12 @@ sfs_reclaim(struct vnode *v)
 	}
 	vnodearray_remove(sfs->sfs_vnodes, ix);
 
-	vnode_cleanup(&sv->sv_absvn);
+	lock_release(sfs->sfs_vnlock);
 
-	vfs_biglock_release();
+	vnode_cleanup(&sv->sv_absvn);
 
 	/* Release the storage for the vnode structure itself. */
+	lock_destroy(sv->sv_lock);
 	kfree(sv);
 
 	/* Done */
@@ -145,9 +160,13 @@ sfs_reclaim(struct vnode *v)
 /*
  * Function to load a inode into memory as a vnode, or dig up one
  * that's already resident.
+ *
+ * The vnode table is locked for the whole search-and-load, so two
+ * threads looking up the same inode can't both load it.
  */
+static
 int
-sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
+sfs_doloadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		 struct sfs_vnode **ret)
 {
 	struct vnode *v;
@@ -156,6 +175,8 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	unsigned i, num;
 	int result;
 
+	KASSERT(lock_do_i_hold(sfs->sfs_vnlock));
+
 	/* Look in the vnodes table */
 	num = vnodearray_num(sfs->sfs_vnodes);
 
@@ -189,6 +210,12 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		return ENOMEM;
 	}
 
+	sv->sv_lock = lock_create("sfs_vnode");
+	if (sv->sv_lock == NULL) {
+		kfree(sv);
+		return ENOMEM;
+	}
+
 	/* Must be in an allocated block */
 	if (!sfs_bused(sfs, ino)) {
 		panic("sfs: %s: Tried to load inode %u from "
@@ -198,6 +225,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Read the block the inode is in */
 	result = sfs_readblock(sfs, ino, &sv->sv_i, sizeof(sv->sv_i));
 	if (result) {
+		lock_destroy(sv->sv_lock);
 		kfree(sv);
 		return result;
 	}
@@ -235,6 +263,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Call the common vnode initializer */
 	result = vnode_init(&sv->sv_absvn, ops, &sfs->sfs_absfs, sv);
 	if (result) {
+		lock_destroy(sv->sv_lock);
 		kfree(sv);
 		return result;
 	}
@@ -246,6 +275,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_absvn, NULL);
 	if (result) {
 		vnode_cleanup(&sv->sv_absvn);
+		lock_destroy(sv->sv_lock);
 		kfree(sv);
 		return result;
 	}
@@ -255,6 +285,18 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	return 0;
 }
 
+int
+sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
+		 struct sfs_vnode **ret)
+{
+	int result;
+
+	lock_acquire(sfs->sfs_vnlock);
+	result = sfs_doloadvnode(sfs, ino, forcetype, ret);
+	lock_release(sfs->sfs_vnlock);
+	return result;
+}
+
 /*
  * Create a new filesystem object and hand back its vnode.
  */
@@ -296,25 +338,21 @@ sfs_getroot(struct fs *fs, struct vnode **ret)
 	struct sfs_vnode *sv;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = sfs_loadvnode(sfs, SFS_ROOTDIR_INO, SFS_TYPE_INVAL, &sv);
 	if (result) {
 		kprintf("sfs: %s: getroot: Cannot load root vnode\n",
 			sfs->sfs_sb.sb_volname);
-		vfs_biglock_release();
 		return result;
 	}
 
+	/* The type never changes, so no need for sv_lock here */
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
 		kprintf("sfs: %s: getroot: not directory (type %u)\n",
 			sfs->sfs_sb.sb_volname, sv->sv_i.sfi_type);
-		vfs_biglock_release();
+		VOP_DECREF(&sv->sv_absvn);
 		return EINVAL;
 	}
 
-	vfs_biglock_release();
-
 	*ret = &sv->sv_absvn;
 	return 0;
 }
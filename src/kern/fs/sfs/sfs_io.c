@@ -36,7 +36,7 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <uio.h>
-#include <vfs.h>
+#include <synch.h>
 #include <device.h>
 #include <sfs.h>
 #include "sfsprivate.h"
@@ -62,8 +62,6 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 	int result;
 	int tries=0;
 
-	KASSERT(vfs_biglock_do_i_hold());
-
 	DEBUG(DB_SFS, "sfs: %s %llu\n",
 	      uio->uio_rw == UIO_READ ? "read" : "write",
 	      uio->uio_offset / SFS_BLOCKSIZE);
@@ -150,27 +148,26 @@ int
 sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	      uint32_t skipstart, uint32_t len)
 {
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	daddr_t diskblock;
+	uint32_t fileblock;
+	int result;
+
 	/*
 	 * I/O buffer for handling partial sectors.
 	 *
 	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
+	 * you would get space from the disk buffer cache for this.
+	 * It used to be a static area, but then only one thread at a
+	 * time could be in here; now each caller gets its own.
 	 */
-	static char iobuf[SFS_BLOCKSIZE];
-
-	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
-	daddr_t diskblock;
-	uint32_t fileblock;
-	int result;
+	char *iobuf;
 
 	/* Allocate missing blocks if and only if we're writing */
 	bool doalloc = (uio->uio_rw==UIO_WRITE);
 
 	KASSERT(skipstart + len <= SFS_BLOCKSIZE);
-
-	/* We're using a global static buffer; it had better be locked */
-	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(lock_do_i_hold(sv->sv_lock));
 
 	/* Compute the block offset of this block in the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
@@ -181,21 +178,26 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 		return result;
 	}
 
+	iobuf = kmalloc(SFS_BLOCKSIZE);
+	if (iobuf == NULL) {
+		return ENOMEM;
+	}
+
 	if (diskblock == 0) {
 		/*
 		 * There was no block mapped at this point in the file.
 		 * Zero the buffer.
 		 */
 		KASSERT(uio->uio_rw == UIO_READ);
-		bzero(iobuf, sizeof(iobuf));
+		bzero(iobuf, SFS_BLOCKSIZE);
 	}
 	else {
 		/*
 		 * Read the block.
 		 */
-		result = sfs_readblock(sfs, diskblock, iobuf, sizeof(iobuf));
+		result = sfs_readblock(sfs, diskblock, iobuf, SFS_BLOCKSIZE);
 		if (result) {
-			return result;
+			goto out;
 		}
 	}
 
@@ -204,20 +206,19 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	 */
 	result = uiomove(iobuf+skipstart, len, uio);
 	if (result) {
-		return result;
+		goto out;
 	}
 
 	/*
 	 * If it was a write, write back the modified block.
 	 */
 	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_writeblock(sfs, diskblock, iobuf, sizeof(iobuf));
-		if (result) {
-			return result;
-		}
+		result = sfs_writeblock(sfs, diskblock, iobuf, SFS_BLOCKSIZE);
 	}
 
-	return 0;
+ out:
+	kfree(iobuf);
+	return result;
 }
 
 /*
@@ -418,13 +419,12 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	 * I/O buffer for metadata ops.
 	 *
 	 * Note: in real life (and when you've done the fs assignment) you
-	 * would get space from the disk buffer cache for this, not use a
-	 * static area.
+	 * would get space from the disk buffer cache for this, not
+	 * kmalloc it on every call.
 	 */
-	static char metaiobuf[SFS_BLOCKSIZE];
+	char *metaiobuf;
 
-	/* We're using a global static buffer; it had better be locked */
-	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(lock_do_i_hold(sv->sv_lock));
 
 	/* Figure out which block of the vnode (directory, whatever) this is */
 	vnblock = actualpos / SFS_BLOCKSIZE;
@@ -446,9 +446,15 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 		return 0;
 	}
 
+	metaiobuf = kmalloc(SFS_BLOCKSIZE);
+	if (metaiobuf == NULL) {
+		return ENOMEM;
+	}
+
 	/* Read the block */
-	result = sfs_readblock(sfs, diskblock, metaiobuf, sizeof(metaiobuf));
+	result = sfs_readblock(sfs, diskblock, metaiobuf, SFS_BLOCKSIZE);
 	if (result) {
+		kfree(metaiobuf);
 		return result;
 	}
 
@@ -462,8 +468,9 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 
 		/* Write the block back */
 		result = sfs_writeblock(sfs, diskblock,
-					metaiobuf, sizeof(metaiobuf));
+					metaiobuf, SFS_BLOCKSIZE);
 		if (result) {
+			kfree(metaiobuf);
 			return result;
 		}
 
@@ -476,5 +483,6 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	}
 
 	/* Done */
+	kfree(metaiobuf);
 	return 0;
 }
@@ -39,9 +39,16 @@
 #include <lib.h>
 #include <uio.h>
 #include <vfs.h>
+#include <synch.h>
 #include <sfs.h>
+#include <textcache.h>
 #include "sfsprivate.h"
 
+/*
+ * Size of the bounce buffer used for I/O to and from user memory.
+ */
+#define SFS_BOUNCESIZE  (8*SFS_BLOCKSIZE)
+
 ////////////////////////////////////////////////////////////
 // Vnode operations.
 
@@ -90,6 +97,83 @@ sfs_eachopendir(struct vnode *v, int openflags)
 	return 0;
 }
 
+/*
+ * Do file I/O with the vnode locked.
+ *
+ * Copying to or from user memory can fault, and a fault on a mapped
+ * file reads that file with VOP_READ. If we did that with sv_lock
+ * held we could deadlock on ourselves, or with another thread doing
+ * the same thing the other way around. So user I/O goes through a
+ * kernel bounce buffer a chunk at a time and the user copy happens
+ * with the vnode unlocked. Each chunk is atomic with respect to other
+ * I/O on the file, but a large transfer as a whole is not.
+ */
+static
+int
+sfs_lockedio(struct sfs_vnode *sv, struct uio *uio)
+{
+	struct iovec iov;
+	struct uio ku;
+	char *buf;
+	off_t pos;
+	size_t len, done;
+	int result = 0;
+
+	if (uio->uio_segflg == UIO_SYSSPACE) {
+		lock_acquire(sv->sv_lock);
+		result = sfs_io(sv, uio);
+		lock_release(sv->sv_lock);
+		return result;
+	}
+
+	buf = kmalloc(SFS_BOUNCESIZE);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+
+	while (uio->uio_resid > 0) {
+		pos = uio->uio_offset;
+		len = uio->uio_resid;
+		if (len > SFS_BOUNCESIZE) {
+			len = SFS_BOUNCESIZE;
+		}
+
+		if (uio->uio_rw == UIO_READ) {
+			uio_kinit(&iov, &ku, buf, len, pos, UIO_READ);
+			lock_acquire(sv->sv_lock);
+			result = sfs_io(sv, &ku);
+			lock_release(sv->sv_lock);
+			done = len - ku.uio_resid;
+			if (result == 0 && done > 0) {
+				result = uiomove(buf, done, uio);
+			}
+			if (result || done < len) {
+				/* error, or EOF */
+				break;
+			}
+		}
+		else {
+			result = uiomove(buf, len, uio);
+			if (result) {
+				break;
+			}
+			uio_kinit(&iov, &ku, buf, len, pos, UIO_WRITE);
+			lock_acquire(sv->sv_lock);
+			result = sfs_io(sv, &ku);
+			lock_release(sv->sv_lock);
+			if (result) {
+				/* Don't claim what didn't make it to disk */
+				uio->uio_resid += ku.uio_resid;
+				uio->uio_offset -= ku.uio_resid;
+				break;
+			}
+		}
+	}
+
+	kfree(buf);
+	return result;
+}
+
 /*
  * Called for read(). sfs_io() does the work.
  */
@@ -98,15 +182,10 @@ int
 sfs_read(struct vnode *v, struct uio *uio)
 {
 	struct sfs_vnode *sv = v->vn_data;
-	int result;
 
 	KASSERT(uio->uio_rw==UIO_READ);
 
-	vfs_biglock_acquire();
-	result = sfs_io(sv, uio);
-	vfs_biglock_release();
-
-	return result;
+	return sfs_lockedio(sv, uio);
 }
 
 /*
@@ -121,10 +200,8 @@ sfs_write(struct vnode *v, struct uio *uio)
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
-	vfs_biglock_acquire();
-	result = sfs_io(sv, uio);
-	vfs_biglock_release();
-
+	result = sfs_lockedio(sv, uio);
+	textcache_invalidate(v);
 	return result;
 }
 
@@ -164,8 +241,10 @@ sfs_stat(struct vnode *v, struct stat *statbuf)
 		return result;
 	}
 
+	lock_acquire(sv->sv_lock);
 	statbuf->st_size = sv->sv_i.sfi_size;
 	statbuf->st_nlink = sv->sv_i.sfi_linkcount;
+	lock_release(sv->sv_lock);
 
 	/* We don't support this yet */
 	statbuf->st_blocks = 0;
@@ -185,16 +264,13 @@ sfs_gettype(struct vnode *v, uint32_t *ret)
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = v->vn_fs->fs_data;
 
-	vfs_biglock_acquire();
-
+	/* The type never changes, so this doesn't need sv_lock. */
 	switch (sv->sv_i.sfi_type) {
 	case SFS_TYPE_FILE:
 		*ret = S_IFREG;
-		vfs_biglock_release();
 		return 0;
 	case SFS_TYPE_DIR:
 		*ret = S_IFDIR;
-		vfs_biglock_release();
 		return 0;
 	}
 	panic("sfs: %s: gettype: Invalid inode type (inode %u, type %u)\n",
@@ -224,22 +300,30 @@ sfs_fsync(struct vnode *v)
 	struct sfs_vnode *sv = v->vn_data;
 	int result;
 
-	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 	result = sfs_sync_inode(sv);
-	vfs_biglock_release();
+	lock_release(sv->sv_lock);
 
 	return result;
 }
 
 /*
- * Called for mmap().
+ * Called for mmap(). Any part of a regular file can be mapped; the VM
+ * system pages it in and out through sfs_read and sfs_write, so there
+ * is nothing to set up here.
  */
 static
 int
-sfs_mmap(struct vnode *v   /* add stuff as needed */)
+sfs_mmap(struct vnode *v, off_t offset, size_t len, int prot)
 {
 	(void)v;
-	return ENOSYS;
+	(void)len;
+	(void)prot;
+
+	if (offset < 0) {
+		return EINVAL;
+	}
+	return 0;
 }
 
 /*
@@ -250,8 +334,14 @@ int
 sfs_truncate(struct vnode *v, off_t len)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	int result;
+
+	lock_acquire(sv->sv_lock);
+	result = sfs_itrunc(sv, len);
+	lock_release(sv->sv_lock);
+	textcache_invalidate(v);
 
-	return sfs_itrunc(sv, len);
+	return result;
 }
 
 /*
@@ -289,37 +379,36 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	uint32_t ino;
 	int result;
 
-	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 
 	/* Look up the name */
 	result = sfs_dir_findname(sv, name, &ino, NULL, NULL);
 	if (result!=0 && result!=ENOENT) {
-		vfs_biglock_release();
+		lock_release(sv->sv_lock);
 		return result;
 	}
 
 	/* If it exists and we didn't want it to, fail */
 	if (result==0 && excl) {
-		vfs_biglock_release();
+		lock_release(sv->sv_lock);
 		return EEXIST;
 	}
 
 	if (result==0) {
 		/* We got something; load its vnode and return */
 		result = sfs_loadvnode(sfs, ino, SFS_TYPE_INVAL, &newguy);
+		lock_release(sv->sv_lock);
 		if (result) {
-			vfs_biglock_release();
 			return result;
 		}
 		*ret = &newguy->sv_absvn;
-		vfs_biglock_release();
 		return 0;
 	}
 
 	/* Didn't exist - create it */
 	result = sfs_makeobj(sfs, SFS_TYPE_FILE, &newguy);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(sv->sv_lock);
 		return result;
 	}
 
@@ -329,20 +418,22 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	/* Link it into the directory */
 	result = sfs_dir_link(sv, name, newguy->sv_ino, NULL);
 	if (result) {
+		lock_release(sv->sv_lock);
 		VOP_DECREF(&newguy->sv_absvn);
-		vfs_biglock_release();
 		return result;
 	}
 
 	/* Update the linkcount of the new file */
+	lock_acquire(newguy->sv_lock);
 	newguy->sv_i.sfi_linkcount++;
 
 	/* and consequently mark it dirty. */
 	newguy->sv_dirty = true;
+	lock_release(newguy->sv_lock);
 
-	*ret = &newguy->sv_absvn;
+	lock_release(sv->sv_lock);
 
-	vfs_biglock_release();
+	*ret = &newguy->sv_absvn;
 	return 0;
 }
 
@@ -361,26 +452,27 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 
 	KASSERT(file->vn_fs == dir->vn_fs);
 
-	vfs_biglock_acquire();
-
 	/* Hard links to directories aren't allowed. */
 	if (f->sv_i.sfi_type == SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return EINVAL;
 	}
 
+	lock_acquire(sv->sv_lock);
+
 	/* Create the link */
 	result = sfs_dir_link(sv, name, f->sv_ino, NULL);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(sv->sv_lock);
 		return result;
 	}
 
 	/* and update the link count, marking the inode dirty */
+	lock_acquire(f->sv_lock);
 	f->sv_i.sfi_linkcount++;
 	f->sv_dirty = true;
+	lock_release(f->sv_lock);
 
-	vfs_biglock_release();
+	lock_release(sv->sv_lock);
 	return 0;
 }
 
@@ -396,28 +488,44 @@ sfs_remove(struct vnode *dir, const char *name)
 	int slot;
 	int result;
 
-	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 
 	/* Look for the file and fetch a vnode for it. */
 	result = sfs_lookonce(sv, name, &victim, &slot);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(sv->sv_lock);
 		return result;
 	}
 
+	/*
+	 * Directories are rmdir's business. (This also keeps us from
+	 * trying to lock sv twice if the name is ".".)
+	 */
+	if (victim->sv_i.sfi_type == SFS_TYPE_DIR) {
+		lock_release(sv->sv_lock);
+		VOP_DECREF(&victim->sv_absvn);
+		return EISDIR;
+	}
+
 	/* Erase its directory entry. */
 	result = sfs_dir_unlink(sv, slot);
 	if (result==0) {
 		/* If we succeeded, decrement the link count. */
+		lock_acquire(victim->sv_lock);
 		KASSERT(victim->sv_i.sfi_linkcount > 0);
 		victim->sv_i.sfi_linkcount--;
 		victim->sv_dirty = true;
+		lock_release(victim->sv_lock);
 	}
 
-	/* Discard the reference that sfs_lookonce got us */
+	lock_release(sv->sv_lock);
+
+	/*
+	 * Discard the reference that sfs_lookonce got us. This may
+	 * reclaim the file, which takes its lock, so do it last.
+	 */
 	VOP_DECREF(&victim->sv_absvn);
 
-	vfs_biglock_release();
 	return result;
 }
 
@@ -438,15 +546,15 @@ sfs_rename(struct vnode *d1, const char *n1,
 	int slot1, slot2;
 	int result, result2;
 
-	vfs_biglock_acquire();
-
 	KASSERT(d1==d2);
 	KASSERT(sv->sv_ino == SFS_ROOTDIR_INO);
 
+	lock_acquire(sv->sv_lock);
+
 	/* Look up the old name of the file and get its inode and slot number*/
 	result = sfs_lookonce(sv, n1, &g1, &slot1);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(sv->sv_lock);
 		return result;
 	}
 
@@ -467,8 +575,10 @@ sfs_rename(struct vnode *d1, const char *n1,
 	}
 
 	/* Increment the link count, and mark inode dirty */
+	lock_acquire(g1->sv_lock);
 	g1->sv_i.sfi_linkcount++;
 	g1->sv_dirty = true;
+	lock_release(g1->sv_lock);
 
 	/* Unlink the old slot */
 	result = sfs_dir_unlink(sv, slot1);
@@ -480,14 +590,17 @@ sfs_rename(struct vnode *d1, const char *n1,
 	 * Decrement the link count again, and mark the inode dirty again,
 	 * in case it's been synced behind our back.
 	 */
+	lock_acquire(g1->sv_lock);
 	KASSERT(g1->sv_i.sfi_linkcount>0);
 	g1->sv_i.sfi_linkcount--;
 	g1->sv_dirty = true;
+	lock_release(g1->sv_lock);
+
+	lock_release(sv->sv_lock);
 
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_absvn);
 
-	vfs_biglock_release();
 	return 0;
 
  puke_harder:
@@ -503,11 +616,13 @@ sfs_rename(struct vnode *d1, const char *n1,
 		panic("sfs: %s: rename: Cannot recover\n",
 		      sfs->sfs_sb.sb_volname);
 	}
+	lock_acquire(g1->sv_lock);
 	g1->sv_i.sfi_linkcount--;
+	lock_release(g1->sv_lock);
  puke:
+	lock_release(sv->sv_lock);
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_absvn);
-	vfs_biglock_release();
 	return result;
 }
 
@@ -525,15 +640,12 @@ sfs_lookparent(struct vnode *v, char *path, struct vnode **ret,
 {
 	struct sfs_vnode *sv = v->vn_data;
 
-	vfs_biglock_acquire();
-
+	/* The type never changes, so this doesn't need sv_lock. */
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return ENOTDIR;
 	}
 
 	if (strlen(path)+1 > buflen) {
-		vfs_biglock_release();
 		return ENAMETOOLONG;
 	}
 	strcpy(buf, path);
@@ -541,7 +653,6 @@ sfs_lookparent(struct vnode *v, char *path, struct vnode **ret,
 	VOP_INCREF(&sv->sv_absvn);
 	*ret = &sv->sv_absvn;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -559,22 +670,18 @@ sfs_lookup(struct vnode *v, char *path, struct vnode **ret)
 	struct sfs_vnode *final;
 	int result;
 
-	vfs_biglock_acquire();
-
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return ENOTDIR;
 	}
 
+	lock_acquire(sv->sv_lock);
 	result = sfs_lookonce(sv, path, &final, NULL);
+	lock_release(sv->sv_lock);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	*ret = &final->sv_absvn;
-
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -39,8 +39,61 @@
 #include "opt-dumbvm.h"
 
 struct vnode;
+struct pagetable;
 
 
+#if !OPT_DUMBVM
+/*
+ * The user stack starts out VM_STACKPAGES long and grows down when a
+ * fault lands below it, up to the process's stack limit. That is its
+ * RLIMIT_STACK resource limit, read and set with getrlimit and
+ * setrlimit: VM_STACKLIMIT bytes by default, and at most VM_STACKMAX,
+ * the default hard limit. Both are kept across fork. One unmapped
+ * guard page is always left between the stack and the region below
+ * it, so running off the bottom faults instead of scribbling on the
+ * heap. (The limit must be > 64K so argument blocks of size ARG_MAX
+ * will fit.)
+ */
+#define VM_STACKPAGES    1
+#define VM_STACKLIMIT    (1024 * 1024)
+#define VM_STACKMAX      (16 * 1024 * 1024)
+
+/*
+ * A region is a page-aligned range of virtual addresses that the
+ * process is allowed to touch. Regions do not own any memory: the
+ * frames backing them are recorded in the page table as they are
+ * faulted in.
+ *
+ * A region loaded from an executable or mapped with mmap also records
+ * where its contents come from: RG_FILESIZE bytes of RG_VNODE starting
+ * at file offset RG_FILEOFF go at address RG_FILEVADDR, and the rest
+ * of the region is zero. Pages are read in from the file when first
+ * touched. Writes to a MAP_SHARED mapping (RG_SHARED) are written back
+ * to the file by munmap, fsync and exit; all other writes are private.
+ *
+ * A MAP_SHARED region maps its pages from the shared memory object
+ * RG_SHM (see shm.h), whose page 0 would be at RG_SHMVBASE. For a
+ * MAP_SHARED|MAP_ANON region that is all there is; for a file it is
+ * the file's object, and page 0 is the file's first page.
+ */
+struct region {
+        vaddr_t rg_vbase;               /* first address (page aligned) */
+        size_t rg_npages;               /* length in pages */
+        int rg_readable;
+        int rg_writeable;
+        int rg_executable;
+        struct vnode *rg_vnode;         /* backing file, or NULL */
+        off_t rg_fileoff;               /* where the contents start in it */
+        vaddr_t rg_filevaddr;           /* ...and where they are loaded */
+        size_t rg_filesize;             /* ...and how long they are */
+        struct shm *rg_shm;             /* shared memory object, or NULL */
+        vaddr_t rg_shmvbase;            /* ...and where it starts */
+        bool rg_mapped;                 /* created by mmap */
+        bool rg_shared;                 /* MAP_SHARED: write back to file */
+        struct region *rg_next;         /* next region in the list */
+};
+#endif
+
 /*
  * Address space - data structure associated with the virtual memory
  * space of a process.
@@ -58,7 +111,19 @@ struct addrspace {
         size_t as_npages2;
         paddr_t as_stackpbase;
 #else
-        /* Put stuff here for your VM system */
+        struct region *as_regions;      /* list of valid regions */
+        struct region *as_heap;         /* heap (in as_regions), or NULL */
+        vaddr_t as_brk;                 /* current break (end of heap) */
+        struct region *as_stack;        /* stack (in as_regions), or NULL */
+        size_t as_stacklimit;           /* max stack size in bytes */
+        size_t as_stackmax;             /* most as_stacklimit may be
+                                           raised to */
+        struct pagetable *as_pt;        /* two-level page table */
+        uint32_t as_asid;               /* TLB ASID + generation, or 0 */
+        unsigned as_asidcpu;            /* cpu that as_asid belongs to */
+        unsigned as_faults;             /* calls to vm_fault */
+        unsigned as_preloads;           /* translations loaded by
+                                           fault-around */
 #endif
 };
 
@@ -93,12 +158,59 @@ struct addrspace {
  *                executable into the address space.
  *
  *    as_complete_load - this is called when loading from an executable
- *                is complete.
+ *                is complete. Under the paging VM system, it also sets
+ *                up an empty heap after the program's last segment.
  *
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_find_region - return the region containing VADDR, or NULL if
+ *                the address is not part of the address space. Not
+ *                available under dumbvm.
+ *
+ *    as_growstack - if VADDR is below the stack but within the stack
+ *                limit, grow the stack down to cover it and return
+ *                the stack region; otherwise return NULL. Not
+ *                available under dumbvm.
+ *
+ *    as_setstacklimit - set the stack limit to CUR and its hard limit
+ *                to MAX, both in bytes. Fails with EPERM if MAX is
+ *                above the current hard limit and EINVAL if CUR is
+ *                above MAX or too small to hold ARG_MAX bytes of
+ *                arguments. Mappings made after raising the limit go
+ *                below the new one; the stack still stops growing at
+ *                any made before. Not available under dumbvm.
+ *
+ *    as_map_segment - arrange for the FILESIZE bytes at OFFSET in
+ *                file V to appear at VADDR, within a region already
+ *                set up with as_define_region. Nothing is read until
+ *                the pages are touched; the region keeps a reference
+ *                to V. Not available under dumbvm, where load_elf
+ *                reads segments in directly.
+ *
+ *    as_mmap   - map LEN bytes of file V starting at OFFSET somewhere
+ *                in the address space with protection PROT and
+ *                MAP_SHARED or MAP_PRIVATE semantics (see kern/mman.h),
+ *                and hand back the address chosen. Pages are read in
+ *                when touched. With MAP_ANON, V is NULL and the
+ *                mapping is zero-filled memory instead.
+ *
+ *    as_munmap - remove the mappings, or the parts of them, between
+ *                VADDR and VADDR+LEN, writing back what has changed in
+ *                shared ones.
+ *
+ *    as_sync   - write back the changed pages of every shared mapping
+ *                of file V, or of every shared mapping if V is NULL.
+ *                Like as_mmap and as_munmap, not available under
+ *                dumbvm.
+ *
+ *    as_sbrk   - move the break (end of the heap) by AMOUNT bytes and
+ *                hand back the old break. Heap pages are only
+ *                allocated when touched, and pages given back by a
+ *                negative AMOUNT are freed at once. Not available
+ *                under dumbvm.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
@@ -118,6 +230,23 @@ int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
 
+#if !OPT_DUMBVM
+struct region    *as_find_region(struct addrspace *as, vaddr_t vaddr);
+struct region    *as_growstack(struct addrspace *as, vaddr_t vaddr);
+int               as_setstacklimit(struct addrspace *as, rlim_t cur,
+                                   rlim_t max);
+int               as_map_segment(struct addrspace *as, vaddr_t vaddr,
+                                 size_t memsize, struct vnode *v,
+                                 off_t offset, size_t filesize);
+int               as_mmap(struct addrspace *as, size_t len, int prot,
+                          int flags, struct vnode *v, off_t offset,
+                          vaddr_t *ret);
+int               as_munmap(struct addrspace *as, vaddr_t vaddr, size_t len);
+int               as_sync(struct addrspace *as, struct vnode *v);
+int               as_sbrk(struct addrspace *as, intptr_t amount,
+                          vaddr_t *oldbrk);
+#endif
+
 
 /*
  * Functions in loadelf.c
@@ -0,0 +1,72 @@
+#ifndef _COREMAP_H_
+#define _COREMAP_H_
+
+/*
+ * Coremap: the physical frame allocator used by the paging VM system.
+ *
+ * Every physical page of RAM has one entry in the coremap. Frames
+ * below the first free address at vm_bootstrap time (kernel image,
+ * exception vectors, early ram_stealmem allocations) are marked
+ * fixed and never handed out or freed.
+ *
+ * Functions:
+ *     coremap_bootstrap   - take over physical memory from ram.c.
+ *     coremap_getppages   - allocate NPAGES physically contiguous
+ *                           frames for the kernel. Returns 0 if no
+ *                           suitable run is free.
+ *     coremap_alloc_upage - allocate one frame to back a user page.
+ *                           Returns 0 if out of memory.
+ *     coremap_freeppages  - release an allocation made by either of
+ *                           the above, given its first frame.
+ *     coremap_incref      - add a reference to a user frame (it is
+ *                           now mapped copy-on-write by one more
+ *                           address space).
+ *     coremap_decref      - drop a reference to a user frame; the
+ *                           frame is freed when the last one goes.
+ *     coremap_refcount    - current number of references to a user
+ *                           frame.
+ *     coremap_setowner    - record that the user frame at PADDR is
+ *                           mapped only by AS at VADDR, making it a
+ *                           candidate for eviction.
+ *     coremap_touch       - set the frame's reference bit (called
+ *                           whenever it is loaded into the TLB).
+ *     coremap_pickvictim  - choose a user frame to evict with the
+ *                           clock algorithm and return it, along with
+ *                           its owner's address space and address.
+ *                           The frame stops being a candidate. Returns
+ *                           0 if no frame can be evicted.
+ *     coremap_waitlow     - sleep until free memory drops below the
+ *                           low watermark (for the pageout daemon).
+ *     coremap_abovehigh   - true once free memory is back above the
+ *                           high watermark.
+ *     coremap_getstats    - return the number of frames managed,
+ *                           how many are free (including those in
+ *                           cpu caches) and the fewest free there
+ *                           have been, not counting the caches.
+ *     coremap_getlockstats - return how many times coremap_lock has
+ *                           been taken, and how many of those it was
+ *                           already held.
+ *     coremap_printstats  - print frame usage (for memstats).
+ */
+
+struct addrspace;
+
+void    coremap_bootstrap(void);
+paddr_t coremap_getppages(unsigned long npages);
+paddr_t coremap_alloc_upage(void);
+void    coremap_freeppages(paddr_t paddr);
+void    coremap_incref(paddr_t paddr);
+void    coremap_decref(paddr_t paddr);
+unsigned coremap_refcount(paddr_t paddr);
+void    coremap_setowner(paddr_t paddr, struct addrspace *as, vaddr_t vaddr);
+void    coremap_touch(paddr_t paddr);
+paddr_t coremap_pickvictim(struct addrspace **as, vaddr_t *vaddr);
+void    coremap_waitlow(void);
+bool    coremap_abovehigh(void);
+void    coremap_getstats(unsigned long *nframes, unsigned long *nfree,
+			 unsigned long *minfree);
+void    coremap_getlockstats(unsigned long *acquires,
+			     unsigned long *contended);
+void    coremap_printstats(void);
+
+#endif /* _COREMAP_H_ */
@@ -35,6 +35,8 @@
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
+/* Size of the per-cpu cache of free page frames (paging VM). */
+#define CPU_FRAMECACHE 16
 
 /*
  * Per-cpu structure
@@ -62,6 +64,37 @@ struct cpu {
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
 
+	/*
+	 * TLB management (paging VM). Written only by this cpu with
+	 * interrupts off; other cpus may read the counters for stats.
+	 */
+	unsigned c_tlb_victim;		/* Next TLB slot to replace */
+	unsigned c_tlb_misses;		/* Translations loaded on a miss */
+	unsigned c_tlb_refills;		/* ...straight from the page table */
+	unsigned c_tlb_evictions;	/* ...that replaced a valid entry */
+	unsigned c_tlb_flushes;		/* Whole-TLB invalidations */
+	unsigned c_tlb_preloads;	/* Neighbors loaded by fault-around */
+	uint32_t c_asid_cache;		/* Last ASID handed out + generation */
+	unsigned c_asid;		/* ASID loaded in the MMU */
+	unsigned c_asid_rollovers;	/* Times we ran out of ASIDs */
+
+	/*
+	 * Cache of free page frames (paging VM), so that single-page
+	 * allocations don't need the coremap lock. Protected by
+	 * c_framecache_lock, which other cpus only take to reclaim
+	 * the frames when memory runs out; see vm/coremap.c.
+	 */
+	struct spinlock c_framecache_lock;
+	paddr_t c_framecache[CPU_FRAMECACHE];
+	unsigned c_nframecache;		/* Frames in c_framecache */
+	unsigned c_fc_allocs;		/* Frames handed out from it */
+	unsigned c_fc_frees;		/* Frames given back to it */
+	unsigned c_fc_refills;		/* Batches taken from the coremap */
+	unsigned c_fc_drains;		/* Batches returned to the coremap */
+	unsigned c_fc_reclaims;		/* Emptied by a starved allocation */
+	int c_fc_nkernel;		/* Kernel frames out, net of frees */
+	int c_fc_nuser;			/* User frames out, net of frees */
+
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the runqueue lock.
@@ -69,6 +102,9 @@ struct cpu {
 	bool c_isidle;			/* True if this cpu is idle */
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
+	unsigned c_steals;		/* Threads taken from other cpus */
+	unsigned c_stolen;		/* Threads other cpus took from us */
+	unsigned c_stealskips;		/* Steals refused: threads too warm */
 
 	/*
 	 * Accessed by other cpus.
@@ -107,6 +143,13 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Enumerate cpus: cpu_count returns how many there are and cpu_get
+ * returns the one with c_number N.
+ */
+unsigned cpu_count(void);
+struct cpu *cpu_get(unsigned n);
+
 /*
  * Produce a string describing the CPU type.
  */
@@ -0,0 +1,40 @@
+#ifndef _KERN_MMAN_H_
+#define _KERN_MMAN_H_
+
+/*
+ * Definitions for mmap() and munmap().
+ *
+ * The call is
+ *
+ *     void *mmap(void *addr, size_t len, int prot, int flags,
+ *                int fd, off_t offset);
+ *
+ * ADDR is only a hint and is currently ignored. OFFSET must be a
+ * multiple of the page size. On failure mmap returns MAP_FAILED.
+ *
+ * All MAP_SHARED mappings of a file share its pages, so they see each
+ * other's writes at once; the changes reach the file at munmap, fsync
+ * or exit.
+ *
+ * With MAP_ANON, FD and OFFSET are ignored and the mapping is zero
+ * filled. MAP_SHARED|MAP_ANON memory is shared with child processes
+ * across fork; MAP_PRIVATE|MAP_ANON memory is copied like the heap.
+ */
+
+/* Protection bits for the prot argument */
+#define PROT_NONE     0x0    /* No access */
+#define PROT_READ     0x1    /* Pages may be read */
+#define PROT_WRITE    0x2    /* Pages may be written */
+#define PROT_EXEC     0x4    /* Pages may be executed */
+
+/* Flags for the flags argument (exactly one of these) */
+#define MAP_SHARED    0x1    /* Writes go back to the file */
+#define MAP_PRIVATE   0x2    /* Writes are private to the process */
+
+/* ...optionally with */
+#define MAP_ANON      0x4    /* No file; zero-filled memory */
+
+#define MAP_FAILED    ((void *)-1)
+
+
+#endif /* _KERN_MMAN_H_ */
@@ -88,8 +88,8 @@
 //#define SYS_wait4      34
 //#define SYS_getrusage  35
 //                              (resource limits)
-//#define SYS_getrlimit  36
-//#define SYS_setrlimit  37
+#define SYS_getrlimit    36
+#define SYS_setrlimit    37
 //                              (process priority control)
 //#define SYS_getpriority 38
 //#define SYS_setpriority 39
@@ -196,6 +196,7 @@
 #define SYS_sync         118
 #define SYS_reboot       119
 //#define SYS___sysctl   120
+#define SYS_vmstat       121
 
 /*CALLEND*/
 
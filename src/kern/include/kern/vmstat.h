@@ -0,0 +1,44 @@
+#ifndef _KERN_VMSTAT_H_
+#define _KERN_VMSTAT_H_
+
+/*
+ * Virtual memory statistics, as returned by
+ *
+ *     int vmstat(struct vmstat *buf);
+ *
+ * The event counters count since boot and only ever go up; the rest
+ * describe the system (or, for the vs_my fields, the calling
+ * process) at the time of the call. Sizes are in pages of
+ * vs_pagesize bytes.
+ */
+struct vmstat {
+	/* Physical memory */
+	__u32 vs_pagesize;      /* bytes per page */
+	__u32 vs_frames;        /* frames managed by the VM system */
+	__u32 vs_free;          /* ...free now */
+	__u32 vs_minfree;       /* ...fewest free since boot */
+
+	/* Swap */
+	__u32 vs_swapslots;     /* swap slots, 0 if no swap */
+	__u32 vs_swapused;      /* ...in use */
+
+	/* Faults */
+	__u32 vs_readfaults;    /* TLB misses on reads */
+	__u32 vs_writefaults;   /* TLB misses on writes */
+	__u32 vs_rofaults;      /* writes to pages loaded read-only */
+	__u32 vs_refills;       /* misses served straight from the page table */
+
+	/* What the faults did */
+	__u32 vs_zerofills;     /* pages zero-filled on first touch */
+	__u32 vs_cowcopies;     /* copy-on-write pages copied */
+	__u32 vs_filereads;     /* pages read in from files */
+	__u32 vs_pageins;       /* pages read in from swap */
+	__u32 vs_pageouts;      /* pages written out to swap */
+
+	/* The calling process */
+	__u32 vs_myfaults;      /* faults taken */
+	__u32 vs_myresident;    /* pages in memory (resident set size) */
+	__u32 vs_myswapped;     /* pages in swap */
+};
+
+#endif /* _KERN_VMSTAT_H_ */
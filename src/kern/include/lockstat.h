@@ -0,0 +1,67 @@
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics (options lockstat).
+ *
+ * Locks are counted by name: every spinlock or sleep lock given the
+ * same name shares one record, so e.g. all the per-cpu run queue
+ * locks add up to one "runqueue" line. Spinlocks that never got a
+ * name (see spinlock_setname) are counted together as "(unnamed)",
+ * and names past the end of the table as "(other)".
+ *
+ * A record can be shared by locks held at the same time on different
+ * cpus, so its counters have a lock of their own, ls_lock. That is a
+ * bare spinlock word rather than a struct spinlock, because taking a
+ * struct spinlock counts itself here. Both callers already hold a
+ * spinlock and so run with interrupts off; lockstat_print and
+ * lockstat_reset turn them off themselves.
+ *
+ * Functions:
+ *     lockstat_get      - find or make the record for NAME and KIND.
+ *     lockstat_spin     - count an acquire of a spinlock that spun
+ *                         SPINS times first. ST may be NULL.
+ *     lockstat_sleep    - count an acquire of a sleep lock that had
+ *                         to wait (CONTENDED), spun SPINS times, and
+ *                         slept from BEFORE to AFTER (both NULL if it
+ *                         never slept).
+ *     lockstat_print    - print the MAX most contended locks.
+ *     lockstat_reset    - zero all the counters.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+#include <spinlock.h>
+
+#define LOCKSTAT_MAX            128     /* distinct names we keep */
+#define LOCKSTAT_NAMELEN        24      /* longer names are cut off */
+
+/* Kinds */
+#define LOCKSTAT_SPIN           0       /* struct spinlock */
+#define LOCKSTAT_SLEEP          1       /* struct lock */
+
+struct lockstat {
+	char ls_name[LOCKSTAT_NAMELEN];
+	unsigned ls_kind;
+	spinlock_data_t ls_lock;        /* protects the counters */
+	uint32_t ls_acquires;           /* times acquired */
+	uint32_t ls_contended;          /* ...that had to wait */
+	uint64_t ls_spins;              /* busy-wait iterations */
+	uint64_t ls_sleepns;            /* nanoseconds asleep */
+};
+
+struct timespec;
+
+struct lockstat *lockstat_get(const char *name, unsigned kind);
+void lockstat_spin(struct lockstat *st, unsigned spins);
+void lockstat_sleep(struct lockstat *st, bool contended, unsigned spins,
+		    const struct timespec *before,
+		    const struct timespec *after);
+void lockstat_print(unsigned max);
+void lockstat_reset(void);
+
+#endif /* OPT_LOCKSTAT */
+
+#endif /* _LOCKSTAT_H_ */
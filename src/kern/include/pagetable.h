@@ -0,0 +1,95 @@
+#ifndef _PAGETABLE_H_
+#define _PAGETABLE_H_
+
+/*
+ * Two-level page table for user address spaces.
+ *
+ * A user virtual address is split into a 10-bit directory index, a
+ * 10-bit table index and a 12-bit page offset. The directory and each
+ * second-level table fill exactly one page; second-level tables are
+ * only allocated once something in their 4M slice is mapped.
+ *
+ * A page table entry holds the physical frame in its top 20 bits,
+ * like a TLB entry, and flags in the low bits. An entry is in one of
+ * four states:
+ *
+ *     0                       never touched
+ *     frame | PTE_VALID       resident (maybe also PTE_COW)
+ *     frame | PTE_PAGEOUT     being written to swap; not mapped
+ *     slot  | PTE_SWAPPED     in swap slot number PTE_SLOT(pte)
+ *
+ * Resident entries of pages the process may not write also carry
+ * PTE_RDONLY, copied from the region when the page is faulted in, so
+ * that TLB refills can tell how to map the page without looking at
+ * the region list.
+ *
+ * Pages of shared memory objects (shm.c), whether anonymous or of a
+ * MAP_SHARED file mapping, carry PTE_SHARED, which tells pt_copy to
+ * share them with the child outright instead of copy-on-write.
+ *
+ * Pages of shared file mappings carry PTE_DIRTY, resident or swapped,
+ * once they have been written and until they are written back to the
+ * file. Until then they are also PTE_RDONLY, so the first write
+ * faults and can set it.
+ *
+ * Entries only leave PTE_PAGEOUT with the VM lock held, so anyone who
+ * finds one waits with vm_pageout_wait and looks again.
+ */
+
+typedef uint32_t pte_t;
+
+#define PT_L1_SHIFT     22
+#define PT_L2_SHIFT     12
+#define PT_NENTRIES     1024
+
+#define PT_L1_INDEX(va) (((va) >> PT_L1_SHIFT) & (PT_NENTRIES - 1))
+#define PT_L2_INDEX(va) (((va) >> PT_L2_SHIFT) & (PT_NENTRIES - 1))
+
+#define PTE_FRAME       0xfffff000      /* physical frame number */
+#define PTE_VALID       0x00000001      /* entry maps a frame */
+#define PTE_COW         0x00000002      /* frame is shared; copy on write */
+#define PTE_SWAPPED     0x00000004      /* page is in swap */
+#define PTE_PAGEOUT     0x00000008      /* page is on its way to swap */
+#define PTE_RDONLY      0x00000010      /* no write permission */
+#define PTE_DIRTY       0x00000020      /* file page needs writing back */
+#define PTE_SHARED      0x00000040      /* shared memory; never COW */
+
+#define PTE_SLOTSHIFT   12
+#define PTE_SLOT(pte)   ((pte) >> PTE_SLOTSHIFT)
+#define PTE_SLOTMAX     (1U << (32 - PTE_SLOTSHIFT))
+
+struct pagetable {
+	pte_t *pt_dir[PT_NENTRIES];     /* second-level tables, or NULL */
+};
+
+/*
+ * Functions:
+ *     pt_create  - allocate an empty page table.
+ *     pt_destroy - free the page table and drop its reference to
+ *                  every frame and swap slot it maps.
+ *     pt_lookup  - return a pointer to the entry for VADDR. If CREATE
+ *                  is set, allocate the second-level table if needed;
+ *                  otherwise return NULL when there is none. Also
+ *                  returns NULL on out-of-memory.
+ *     pt_copy    - make NEWPT map every page mapped by OLDPT. The
+ *                  frames are shared, not copied: both entries are
+ *                  marked PTE_COW (unless PTE_SHARED) and the frame
+ *                  gains a reference.
+ *                  Swapped pages share the swap slot the same way.
+ *                  The caller must flush any writable TLB entries
+ *                  for OLDPT.
+ *     pt_count   - count the pages that are in memory (including any
+ *                  on their way out) and the pages in swap.
+ *
+ * pt_destroy, pt_copy and pt_count must be called with the VM lock
+ * held.
+ */
+
+struct pagetable *pt_create(void);
+void              pt_destroy(struct pagetable *pt);
+pte_t            *pt_lookup(struct pagetable *pt, vaddr_t vaddr, bool create);
+int               pt_copy(struct pagetable *oldpt, struct pagetable *newpt);
+void              pt_count(struct pagetable *pt, unsigned *resident,
+			   unsigned *swapped);
+
+#endif /* _PAGETABLE_H_ */
@@ -50,9 +50,14 @@
 
 /*
  * In-memory inode
+ *
+ * sv_lock protects sv_i, sv_dirty, and the file's contents (for a
+ * directory, its entries). sv_ino and the inode type never change
+ * while the vnode is loaded and may be read without it.
  */
 struct sfs_vnode {
 	struct vnode sv_absvn;          /* abstract vnode structure */
+	struct lock *sv_lock;           /* protects everything below */
 	struct sfs_dinode sv_i;		/* copy of on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
@@ -60,12 +65,18 @@ struct sfs_vnode {
 
 /*
  * In-memory info for a whole fs volume
+ *
+ * Lock order: a directory's sv_lock, then the sv_lock of a file in
+ * it, then sfs_vnlock, then sfs_freemaplock. Neither of the last two
+ * is held across anything that can take an sv_lock.
  */
 struct sfs_fs {
 	struct fs sfs_absfs;            /* abstract filesystem structure */
+	struct lock *sfs_freemaplock;   /* protects sb and freemap */
 	struct sfs_superblock sfs_sb;	/* copy of on-disk superblock */
 	bool sfs_superdirty;            /* true if superblock modified */
 	struct device *sfs_device;      /* device mounted on */
+	struct lock *sfs_vnlock;        /* protects sfs_vnodes */
 	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	bool sfs_freemapdirty;          /* true if freemap modified */
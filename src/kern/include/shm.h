@@ -0,0 +1,56 @@
+#ifndef _SHM_H_
+#define _SHM_H_
+
+/*
+ * Shared memory objects for MAP_SHARED mappings.
+ *
+ * A shared object is an array of pages that every region mapping it
+ * sees the same frames of, so writes by one process are seen by the
+ * others at once. Regions are inherited across fork by taking another
+ * reference on the object, not copy-on-write.
+ *
+ * MAP_SHARED|MAP_ANON regions each get an object of their own, whose
+ * pages start out zero. MAP_SHARED file regions share one object per
+ * file, indexed by page of the file, so every mapping of the same part
+ * of the file sees the same frames; the VM system reads the pages in
+ * from the file when first touched and writes them back from the
+ * mappings that changed them. Pages are not kept coherent with read
+ * and write on the file.
+ *
+ * The object holds one reference to each of its frames and each page
+ * table entry mapping one holds another, so frames are freed when the
+ * last region lets go of the object and the last mapping is gone.
+ * Frames of shared objects have no coremap owner and are never paged
+ * out.
+ *
+ * Functions:
+ *     shm_create  - make an object of NPAGES pages, none allocated yet,
+ *                   with one reference. Returns NULL if out of memory.
+ *     shm_getfile - return the object for file VN, with a reference
+ *                   added for the caller, making it if there is none
+ *                   and growing it to at least NPAGES pages. Returns
+ *                   NULL if out of memory. The caller must hold a
+ *                   reference to VN as long as it holds the object's.
+ *     shm_incref  - add a reference to the object.
+ *     shm_decref  - drop a reference; the object and its frames go
+ *                   away with the last one.
+ *     shm_getpage - return the frame for page INDEX, or 0 if it hasn't
+ *                   been allocated yet.
+ *     shm_setpage - make PADDR (a user frame, zeroed or filled from
+ *                   the file, whose reference passes to the object)
+ *                   page INDEX.
+ *
+ * All of these must be called with the VM lock held.
+ */
+
+struct shm;
+struct vnode;
+
+struct shm *shm_create(size_t npages);
+struct shm *shm_getfile(struct vnode *vn, size_t npages);
+void        shm_incref(struct shm *shm);
+void        shm_decref(struct shm *shm);
+paddr_t     shm_getpage(struct shm *shm, size_t index);
+void        shm_setpage(struct shm *shm, size_t index, paddr_t paddr);
+
+#endif /* _SHM_H_ */
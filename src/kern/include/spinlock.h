@@ -45,6 +45,11 @@
 /* Get the machine-dependent bits. */
 #include <machine/spinlock.h>
 
+#include "opt-fifosync.h"
+#include "opt-lockstat.h"
+
+struct lockstat;
+
 /*
  * Basic spinlock.
  *
@@ -53,16 +58,30 @@
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
+ *
+ * With the fifosync option spinlocks are ticket locks: each CPU
+ * that wants the lock takes a number from splk_next and waits until
+ * splk_lock (now serving) reaches it, so CPUs get the lock strictly
+ * in the order they asked for it. Otherwise splk_lock is a plain
+ * test-and-set word and whoever gets there first wins.
  */
 struct spinlock {
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
+#if OPT_FIFOSYNC
+	volatile spinlock_data_t splk_next; /* Next ticket to hand out. */
+#endif
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
+#if OPT_LOCKSTAT
+	struct lockstat *splk_stat;	    /* Contention stats, or NULL. */
+#endif
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
+ * (Fields not named start out zero/NULL.)
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_INITIALIZER	{ .splk_lock = SPINLOCK_DATA_INITIALIZER, \
+				  .splk_holder = NULL }
 
 /*
  * Spinlock functions.
@@ -71,18 +90,31 @@ struct spinlock {
  * cleanup	Opposite of init. Lock must be unlocked.
  *
  * acquire	Get the lock, spinning as necessary. Also disables interrupts.
+ * tryacquire	Like acquire, but return false instead of spinning if the
+ *		lock is held.
  * release	Release the lock. May re-enable interrupts.
  *
  * do_i_hold	Check if the current CPU holds the lock.
+ *
+ * setname	Name the lock for lock statistics (options lockstat);
+ *		otherwise it is counted as "(unnamed)". Compiles to
+ *		nothing without the option.
  */
 
 void spinlock_init(struct spinlock *lk);
 void spinlock_cleanup(struct spinlock *lk);
 
 void spinlock_acquire(struct spinlock *lk);
+bool spinlock_tryacquire(struct spinlock *lk);
 void spinlock_release(struct spinlock *lk);
 
 bool spinlock_do_i_hold(struct spinlock *lk);
 
+#if OPT_LOCKSTAT
+void spinlock_setname(struct spinlock *lk, const char *name);
+#else
+#define spinlock_setname(lk, name)	((void)(lk), (void)(name))
+#endif
+
 
 #endif /* _SPINLOCK_H_ */
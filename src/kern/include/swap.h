@@ -0,0 +1,51 @@
+#ifndef _SWAP_H_
+#define _SWAP_H_
+
+/*
+ * Swap space for the paging VM system.
+ *
+ * Swap lives on a raw disk, attached with vfs_swapon, and is divided
+ * into page-sized slots. A bitmap records which slots
+ * are in use. Each slot also has a reference count, because a page
+ * that was swapped out and then shared copy-on-write by fork stays
+ * in the same slot for every address space that maps it.
+ *
+ * No disk is used for swap unless asked for, since whatever is on it
+ * gets overwritten: the "swapon" menu command (which can also go on
+ * the boot command line, e.g. "swapon lhd1; s") calls swap_on. Until
+ * then the system runs without swap: swap_alloc always fails and
+ * pages are never evicted.
+ *
+ * Functions:
+ *     swap_bootstrap   - set up. Called from vm_bootstrap.
+ *     swap_on          - attach the raw disk DEVNAME (e.g. "lhd1") as
+ *                        swap. There can be only one; returns EBUSY if
+ *                        swap is already on, or an error from the
+ *                        device.
+ *     swap_alloc       - reserve a free slot, with one reference.
+ *                        Returns ENOSPC if swap is full or absent.
+ *     swap_incref      - add a reference to a slot.
+ *     swap_decref      - drop a reference; the slot is free again
+ *                        when the last one goes.
+ *     swap_read        - read slot SLOT into the frame at PADDR.
+ *     swap_write       - write the frame at PADDR to slot SLOT.
+ *     swap_getstats    - return the number of slots (0 without a
+ *                        swap device), how many are in use, and how
+ *                        many pages have been read and written.
+ *     swap_printstats  - print slot usage (for memstats).
+ *
+ * swap_read and swap_write sleep; don't hold the VM lock across them.
+ */
+
+void swap_bootstrap(void);
+int  swap_on(const char *devname);
+int  swap_alloc(unsigned *slot);
+void swap_incref(unsigned slot);
+void swap_decref(unsigned slot);
+int  swap_read(unsigned slot, paddr_t paddr);
+int  swap_write(unsigned slot, paddr_t paddr);
+void swap_getstats(unsigned *nslots, unsigned *nused,
+		   unsigned *npageins, unsigned *npageouts);
+void swap_printstats(void);
+
+#endif /* _SWAP_H_ */
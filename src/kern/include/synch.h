@@ -38,6 +38,9 @@
 #include <spinlock.h>
 #include "opt-semlock.h"
 #include "opt-wchanlock.h"
+#include "opt-adaptivelock.h"
+#include "opt-fifosync.h"
+#include "opt-lockstat.h"
 #include "opt-condvars.h"
 
 /*
@@ -61,6 +64,11 @@ void sem_destroy(struct semaphore *);
  *     P (proberen): decrement count. If the count is 0, block until
  *                   the count is 1 again before decrementing.
  *     V (verhogen): increment count.
+ *
+ * With the fifosync option V hands its count straight to the thread
+ * that has been waiting longest instead of incrementing sem_count,
+ * so waiters get through strictly in the order they arrived and a
+ * thread calling P meanwhile cannot barge in ahead of them.
  */
 void P(struct semaphore *);
 void V(struct semaphore *);
@@ -87,14 +95,23 @@ struct lock {
         /* if you want, you can create a spinlock to read owner,
          * but i don't think is mandatory cause if someone that's not the owner reads a wrong data (can be curthread or NULL) there's no problem */
 
-#elif OPT_WCHANLOCK
+#elif OPT_WCHANLOCK || OPT_ADAPTIVELOCK
 
         char *lk_name;
         // add what you need here
         // (don't forget to mark things volatile as needed)
 	    struct wchan *lk_wchan;
 	    struct spinlock wchan_spinlk;
-        struct thread *lk_owner;
+        struct thread *volatile lk_owner;
+#if OPT_ADAPTIVELOCK
+        struct cpu *volatile lk_ownercpu;  /* cpu lk_owner took it on */
+#endif
+#if OPT_FIFOSYNC
+        bool lk_handoff;        /* released to a woken waiter */
+#endif
+#if OPT_LOCKSTAT
+        struct lockstat *lk_stat;       /* contention stats */
+#endif
 
 #else // standard mngmt
 
@@ -117,11 +134,30 @@ void lock_destroy(struct lock *);
  *                   false otherwise.
  *
  * These operations must be atomic. You get to write them.
+ *
+ * With the fifosync option lock_release passes the lock directly to
+ * the longest-waiting sleeper: it is marked handed off rather than
+ * free, so nobody else can grab it before that thread runs.
  */
 void lock_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 
+#if OPT_ADAPTIVELOCK
+/*
+ * Adaptive locks: a thread that finds the lock held by a thread
+ * running on another cpu busy-waits for up to lock_spinmax polls of
+ * the owner, in the hope that it lets go soon, before going to sleep.
+ * Sleeping costs two context switches; a short critical section is
+ * usually over well before that. A holder that isn't running can't
+ * let go until it is rescheduled, so then we sleep at once. Setting
+ * lock_spinmax to 0 gives plain sleeping locks.
+ */
+#define LOCK_SPINMAX    1000
+
+extern unsigned lock_spinmax;
+#endif
+
 
 /*
  * Condition variable.
@@ -168,4 +204,49 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or one writer.
+ * Writers are preferred: once a writer is waiting, newly arriving
+ * readers wait behind it, so a stream of readers cannot starve
+ * writers. Readers are not starved either: when a writer lets go,
+ * every reader waiting at that moment is let in together, ahead of
+ * the next writer.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+struct rwlock {
+        char *rwlock_name;
+        struct spinlock rw_lock;        /* protects the fields below */
+        struct wchan *rw_readwchan;     /* readers wait here */
+        struct wchan *rw_writewchan;    /* writers wait here */
+        unsigned rw_readers;            /* readers holding the lock */
+        unsigned rw_readwaiters;        /* readers sleeping */
+        unsigned rw_writewaiters;       /* writers sleeping */
+        struct thread *rw_writer;       /* writer holding the lock */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading. Blocks while a
+ *                           writer holds the lock or is waiting for it.
+ *    rwlock_release_read  - Give up a read hold.
+ *    rwlock_acquire_write - Get the lock for writing, waiting for all
+ *                           readers and any writer to let go.
+ *    rwlock_release_write - Give up the write hold.
+ *    rwlock_do_i_hold_write - True if the current thread is the writer.
+ *                           (Readers are not tracked individually.)
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
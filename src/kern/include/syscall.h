@@ -34,6 +34,7 @@
 #include <cdefs.h> /* for __DEAD */
 #include "opt-syscalls.h"
 #include "opt-waitpid.h"
+#include "opt-paging.h"
 
 struct trapframe; /* from <machine/trapframe.h> */
 
@@ -76,4 +77,15 @@ void save_status(int status);
 int sys_waitpid(pid_t pid);
 #endif
 
+#if OPT_PAGING
+int sys_sbrk(intptr_t amount, int32_t *retval);
+int sys_mmap(userptr_t addr, size_t len, int prot, int flags, userptr_t args,
+	     int32_t *retval);
+int sys_munmap(userptr_t addr, size_t len);
+int sys_fsync(int fd);
+int sys_vmstat(userptr_t buf);
+int sys_getrlimit(int resource, userptr_t rlp);
+int sys_setrlimit(int resource, const_userptr_t rlp);
+#endif
+
 #endif /* _SYSCALL_H_ */
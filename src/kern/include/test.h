@@ -52,8 +52,11 @@ int threadtest2(int, char **);
 int threadtest3(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
+int lockbench(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int rwtest(int, char **);
+int rwbench(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
@@ -86,6 +89,7 @@ int writestress(int, char **);
 int writestress2(int, char **);
 int longstress(int, char **);
 int createstress(int, char **);
+int readbench(int, char **);
 int printfile(int, char **);
 
 /* other tests */
@@ -94,6 +98,8 @@ int kmallocstress(int, char **);
 int kmalloctest3(int, char **);
 int kmalloctest4(int, char **);
 int nettest(int, char **);
+int tlbpong(int, char **);
+int framebench(int, char **);
 
 /* Routine for running a user-level program. */
 int runprogram(char *progname, int argc, char **argv);
@@ -0,0 +1,76 @@
+#ifndef _TEXTCACHE_H_
+#define _TEXTCACHE_H_
+
+#include "opt-paging.h"
+
+/*
+ * Cache of read-only program pages, so that processes running the
+ * same executable share one copy of its text.
+ *
+ * Entries are keyed by the executable's vnode and the virtual address
+ * the page is loaded at; since the same file always has the same
+ * segment layout, that identifies the page's contents. The cache
+ * holds a reference to each frame and to each vnode. Processes map
+ * cached frames copy-on-write, so a write (e.g. by a debugger) still
+ * gets a private copy.
+ *
+ * Cached frames have no coremap owner and so are never picked for
+ * eviction. Once no process maps one any more it can simply be
+ * dropped, since it can be read back from the file; the VM system
+ * calls textcache_reclaim for that before it starts evicting pages.
+ *
+ * Writing or truncating a file makes its cached pages stale, so the
+ * file systems call textcache_invalidate from those paths. Processes
+ * already running the old text keep the frames they have mapped.
+ *
+ * Functions:
+ *     textcache_lookup     - return the frame caching page VADDR of
+ *                            file VN, with a reference added for the
+ *                            caller, or 0 if it isn't cached.
+ *     textcache_generation - return a stamp to pass to textcache_insert;
+ *                            take it before reading the page in.
+ *     textcache_insert     - add the frame PADDR as page VADDR of VN.
+ *                            The cache takes its own references; the
+ *                            caller keeps the one it had. Returns
+ *                            ENOMEM if there's no memory for the
+ *                            entry, or EAGAIN if some file was
+ *                            invalidated since generation GEN was
+ *                            taken; either way the page just isn't
+ *                            shared.
+ *     textcache_reclaim    - drop every entry no process maps. Returns
+ *                            the number of frames freed. The entries'
+ *                            vnode references are kept until the next
+ *                            textcache_reap.
+ *     textcache_printstats - print cache usage (for memstats).
+ *
+ * All of these must be called with the VM lock held.
+ *
+ *     textcache_reap       - drop the vnode references of the entries
+ *                            reclaimed so far. Takes the VM lock
+ *                            itself, since the last reference to a
+ *                            vnode may do disk I/O; the pageout daemon
+ *                            calls it after each pass.
+ *     textcache_invalidate - drop every entry for VN. Takes the VM lock
+ *                            itself, so call it with no file system
+ *                            locks held; the caller must hold a
+ *                            reference to VN. A no-op in kernels
+ *                            without the paging VM.
+ */
+
+struct vnode;
+
+paddr_t  textcache_lookup(struct vnode *vn, vaddr_t vaddr);
+unsigned textcache_generation(void);
+int      textcache_insert(struct vnode *vn, vaddr_t vaddr, paddr_t paddr,
+			  unsigned gen);
+unsigned textcache_reclaim(void);
+void     textcache_reap(void);
+void     textcache_printstats(void);
+
+#if OPT_PAGING
+void     textcache_invalidate(struct vnode *vn);
+#else
+#define  textcache_invalidate(vn) ((void)(vn))
+#endif
+
+#endif /* _TEXTCACHE_H_ */
@@ -84,6 +84,16 @@ struct thread {
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
 
+	/*
+	 * Scheduler fields; see schedule() in thread.c. Protected by
+	 * the run queue lock of t_cpu.
+	 */
+	unsigned t_priority;		/* Queue level; 0 is the highest */
+	unsigned t_ticks;		/* Hardclocks used at this level */
+	unsigned t_readysince;		/* t_cpu's c_hardclocks when queued */
+	struct cpu *t_lastcpu;		/* CPU thread last ran on, or NULL */
+	unsigned t_lastrun;		/* t_lastcpu's c_hardclocks then */
+
 	/*
 	 * Interrupt state fields.
 	 *
@@ -158,16 +168,26 @@ __DEAD void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Charge the current thread for one hardclock, and yield if its
+ * quantum is used up or a higher-priority thread is waiting. Called
+ * from the timer interrupt.
+ */
+void thread_timeslice(void);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
 void schedule(void);
 
 /*
- * Potentially migrate ready threads to other CPUs. Called from the
- * timer interrupt.
+ * Work stealing (see thread.c): a thread is only moved to another
+ * cpu once it has been off the cpu it last ran on for at least
+ * thread_migrate_hysteresis hardclocks. thread_migstats prints each
+ * cpu's stealing counters.
  */
-void thread_consider_migration(void);
+extern unsigned thread_migrate_hysteresis;
+void thread_migstats(void);
 
 
 #endif /* _THREAD_H_ */
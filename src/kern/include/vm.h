@@ -60,5 +60,76 @@ void vm_tlbshootdown(const struct tlbshootdown *);
 
 /* VM Stats */
 void memstats(void);
+void tlbstats(void);
+
+/*
+ * Fault-around: on a TLB miss, vm_fault also loads the translations
+ * of the other resident pages in the aligned block of vm_faultaround
+ * pages containing the faulting address, so walking through a big
+ * array takes one trap per block instead of one per page. It must be
+ * a power of 2 no larger than VM_FAULTAROUND_MAX; 1 turns it off.
+ * With vm_faultreport set, each process prints how many faults it
+ * took and how many translations were preloaded for it when it exits
+ * (vm_faultstats). Not available under dumbvm.
+ */
+#define VM_FAULTAROUND          8
+#define VM_FAULTAROUND_MAX      32
+
+extern unsigned vm_faultaround;
+extern bool vm_faultreport;
+
+struct addrspace;
+void vm_faultstats(const char *name, struct addrspace *as);
+
+/*
+ * Helpers shared by the pieces of the paging VM system (kern/vm);
+ * not available under dumbvm.
+ *
+ *    vm_lock_acquire, vm_lock_release, vm_lock_do_i_hold - the VM
+ *                   lock, which protects page tables, the coremap's
+ *                   record of page owners and the paging state.
+ *    vm_pageout_wait - with the VM lock held, sleep until some page
+ *                   being written to swap is done (PTE_PAGEOUT).
+ *    vm_can_sleep - assert we are in a context that may block.
+ *    vm_tlbload   - enter a translation in the current CPU's TLB,
+ *                   evicting another one if needed. REFILL says the
+ *                   miss was served straight from the page table
+ *                   (only used for statistics).
+ *    vm_tlbpreload - like vm_tlbload, for a translation nobody has
+ *                   missed on yet (fault-around). Does nothing and
+ *                   returns false if it is already in the TLB.
+ *    vm_tlbflush  - invalidate every TLB entry on the current CPU.
+ *    vm_tlbactivate - switch the current CPU's MMU to AS's address
+ *                   space ID, allocating a new one if AS has none that
+ *                   is still valid on this CPU. Set as_asid to 0 first
+ *                   to retire all of AS's TLB entries.
+ *    vm_tlbinvalidate - remove AS's translation for VADDR from every
+ *                   CPU's TLB and wait until it's gone. Needs the VM
+ *                   lock.
+ *    vm_tlbbootstrap - set up the above; called from vm_bootstrap.
+ *    vm_unmap     - throw away NPAGES pages of AS starting at VADDR:
+ *                   free their frames and swap slots and remove their
+ *                   translations. Touching them again faults in fresh
+ *                   zero-filled pages.
+ *    vm_writeback - write the dirty pages among the NPAGES pages at
+ *                   VADDR of the shared file mapping RG in AS back to
+ *                   the file.
+ */
+struct region;
+
+void vm_lock_acquire(void);
+void vm_lock_release(void);
+bool vm_lock_do_i_hold(void);
+void vm_pageout_wait(void);
+void vm_can_sleep(void);
+void vm_tlbload(vaddr_t vaddr, paddr_t paddr, bool writeable, bool refill);
+bool vm_tlbpreload(vaddr_t vaddr, paddr_t paddr, bool writeable);
+void vm_tlbflush(void);
+void vm_tlbactivate(struct addrspace *as);
+void vm_tlbinvalidate(struct addrspace *as, vaddr_t vaddr);
+void vm_tlbbootstrap(void);
+void vm_unmap(struct addrspace *as, vaddr_t vaddr, size_t npages);
+int vm_writeback(struct addrspace *as, struct region *rg,
+		 vaddr_t vaddr, size_t npages);
 
 #endif /* _VM_H_ */
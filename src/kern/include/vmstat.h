@@ -0,0 +1,37 @@
+#ifndef _VMSTAT_H_
+#define _VMSTAT_H_
+
+/*
+ * VM statistics for the paging VM system (see kern/vmstat.h).
+ *
+ * The fault path counts events with vmstat_count as they happen;
+ * the amount of free memory and swap in use is asked of the coremap
+ * and swap code when somebody wants the numbers.
+ *
+ * Functions:
+ *     vmstat_count      - count one EVENT (a VMS_* value).
+ *     vmstat_get        - fill in VS, with the per-process fields
+ *                         taken from AS (left zero if AS is NULL).
+ *                         Takes the VM lock.
+ *     vmstat_printstats - print the event counters (for memstats).
+ */
+
+#include <kern/vmstat.h>
+
+/* Events */
+#define VMS_READFAULT   0       /* vm_fault, VM_FAULT_READ */
+#define VMS_WRITEFAULT  1       /* vm_fault, VM_FAULT_WRITE */
+#define VMS_ROFAULT     2       /* vm_fault, VM_FAULT_READONLY */
+#define VMS_REFILL      3       /* fault served by the fast path */
+#define VMS_ZEROFILL    4       /* fresh zero-filled page mapped */
+#define VMS_COWCOPY     5       /* copy-on-write page copied */
+#define VMS_FILEREAD    6       /* page read in from a file */
+#define VMS_NEVENTS     7
+
+struct addrspace;
+
+void vmstat_count(unsigned event);
+void vmstat_get(struct addrspace *as, struct vmstat *vs);
+void vmstat_printstats(void);
+
+#endif /* _VMSTAT_H_ */
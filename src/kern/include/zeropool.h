@@ -0,0 +1,25 @@
+#ifndef _ZEROPOOL_H_
+#define _ZEROPOOL_H_
+
+/*
+ * Pool of pre-zeroed page frames for the paging VM system.
+ *
+ * Anonymous pages (heap, stack, BSS) are zero-filled on first touch.
+ * Rather than clearing a frame in the fault handler, vm_fault takes
+ * one that a background thread cleared ahead of time, while the
+ * machine had nothing better to do.
+ *
+ * Functions:
+ *     zeropool_bootstrap  - start the thread that fills the pool.
+ *                           Called from vm_bootstrap.
+ *     zeropool_get        - take a zeroed user frame (as from
+ *                           coremap_alloc_upage) out of the pool.
+ *                           Returns 0 if the pool is empty.
+ *     zeropool_printstats - print pool usage (for memstats).
+ */
+
+void    zeropool_bootstrap(void);
+paddr_t zeropool_get(void);
+void    zeropool_printstats(void);
+
+#endif /* _ZEROPOOL_H_ */
@@ -95,14 +95,33 @@ bitmap_getdata(struct bitmap *b)
         return b->v;
 }
 
+/*
+ * Find the first clear bit in words IX through MAXIX-1, set it, and
+ * return its index. Runs of completely allocated words are skipped
+ * four bytes at a time. (Comparing against all-ones doesn't care
+ * about byte order, so this doesn't break the on-disk format.)
+ */
+static
 int
-bitmap_alloc(struct bitmap *b, unsigned *index)
+bitmap_scan(struct bitmap *b, unsigned ix, unsigned maxix, unsigned *index)
 {
-        unsigned ix;
-        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
         unsigned offset;
-
-        for (ix=0; ix<maxix; ix++) {
+        uint32_t four;
+
+        while (ix < maxix) {
+                if (ix % sizeof(four) == 0 && ix + sizeof(four) <= maxix) {
+                        /*
+                         * Copy rather than cast, so as not to read
+                         * the bytes through a uint32_t pointer. The
+                         * kernel is built freestanding, so ask for the
+                         * builtin, which is expanded inline.
+                         */
+                        __builtin_memcpy(&four, &b->v[ix], sizeof(four));
+                        if (four == 0xffffffff) {
+                                ix += sizeof(four);
+                                continue;
+                        }
+                }
                 if (b->v[ix]!=WORD_ALLBITS) {
                         for (offset = 0; offset < BITS_PER_WORD; offset++) {
                                 WORD_TYPE mask = ((WORD_TYPE)1) << offset;
@@ -116,10 +135,19 @@ bitmap_alloc(struct bitmap *b, unsigned *index)
                         }
                         KASSERT(0);
                 }
+                ix++;
         }
         return ENOSPC;
 }
 
+int
+bitmap_alloc(struct bitmap *b, unsigned *index)
+{
+        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
+
+        return bitmap_scan(b, 0, maxix, index);
+}
+
 static
 inline
 void
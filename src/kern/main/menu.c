@@ -42,9 +42,13 @@
 #include <syscall.h>
 #include <test.h>
 #include <vm.h>
+#include <swap.h>
+#include <lockstat.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
 #include "opt-waitpid.h"
+#include "opt-paging.h"
+#include "opt-lockstat.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -422,6 +426,129 @@ static int cmd_memstats(int nargs, char **args) {
   return 0;
 }
 
+static int cmd_tlbstats(int nargs, char **args) {
+  (void)args;
+
+  if (nargs == 1) {
+    tlbstats();
+  } else {
+    kprintf("Usage: tlbstats\n");
+  }
+
+  return 0;
+}
+
+#if OPT_PAGING
+/*
+ * Command for attaching swap (see swap.h).
+ */
+static
+int
+cmd_swapon(int nargs, char **args)
+{
+	char *device;
+
+	if (nargs != 2) {
+		kprintf("Usage: swapon device:\n");
+		return EINVAL;
+	}
+
+	device = args[1];
+
+	/* Allow (but do not require) colon after device name */
+	if (device[strlen(device)-1]==':') {
+		device[strlen(device)-1] = 0;
+	}
+
+	return swap_on(device);
+}
+
+/*
+ * Command for setting the fault-around block size (see vm.h), and for
+ * turning the per-process fault counts printed at exit on and off.
+ */
+static
+int
+cmd_faultaround(int nargs, char **args)
+{
+	unsigned n;
+
+	if (nargs == 2 && !strcmp(args[1], "report")) {
+		vm_faultreport = !vm_faultreport;
+		kprintf("Per-process fault report %s\n",
+			vm_faultreport ? "on" : "off");
+		return 0;
+	}
+	if (nargs == 2) {
+		n = atoi(args[1]);
+		if (n < 1 || n > VM_FAULTAROUND_MAX || (n & (n - 1)) != 0) {
+			kprintf("faultaround: block size must be a power of 2 "
+				"from 1 to %u\n", VM_FAULTAROUND_MAX);
+			return EINVAL;
+		}
+		vm_faultaround = n;
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: faultaround [npages | report]\n");
+		return EINVAL;
+	}
+
+	kprintf("Fault-around: %u pages\n", vm_faultaround);
+	return 0;
+}
+#endif
+
+/*
+ * Command for showing how often threads moved between cpus, and for
+ * setting how long a thread must have been away from its cpu before
+ * another one may take it.
+ */
+static
+int
+cmd_migrate(int nargs, char **args)
+{
+	if (nargs == 2) {
+		thread_migrate_hysteresis = atoi(args[1]);
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: mig [hysteresis]\n");
+		return EINVAL;
+	}
+
+	thread_migstats();
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for printing the most contended locks (see lockstat.h),
+ * or zeroing the counts.
+ */
+#define LOCKSTAT_SHOW	20
+
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+		kprintf("Lock statistics reset\n");
+		return 0;
+	}
+	if (nargs == 2) {
+		lockstat_print(atoi(args[1]));
+	}
+	else if (nargs == 1) {
+		lockstat_print(LOCKSTAT_SHOW);
+	}
+	else {
+		kprintf("Usage: lockstat [count | reset]\n");
+		return EINVAL;
+	}
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -461,6 +588,9 @@ static const char *opsmenu[] = {
 	"[cd]      Change directory          ",
 	"[pwd]     Print current directory   ",
 	"[sync]    Sync filesystems          ",
+#if OPT_PAGING
+	"[swapon]  Swap to a disk            ",
+#endif
 	"[panic]   Intentional panic         ",
 	"[q]       Quit and shut down        ",
 	NULL
@@ -491,11 +621,18 @@ static const char *testmenu[] = {
 	"[tt3] Thread test 3                 ",
 #if OPT_NET
 	"[net] Network test                  ",
+#endif
+#if OPT_PAGING
+	"[tlbp] TLB context switch benchmark ",
+	"[fcb] Frame cache benchmark         ",
 #endif
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
+	"[lkb] Lock benchmark        (1)     ",
 	"[sy3] CV test               (1)     ",
 	"[sy4] CV test #2            (1)     ",
+	"[rwt] RW lock test                  ",
+	"[rwb] RW lock benchmark     (1)     ",
 	"[semu1-22] Semaphore unit tests     ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress                ",
@@ -503,6 +640,7 @@ static const char *testmenu[] = {
 	"[fs4] FS write stress 2             ",
 	"[fs5] FS long stress                ",
 	"[fs6] FS create stress              ",
+	"[fs7] FS parallel read benchmark    ",
 	NULL
 };
 
@@ -528,6 +666,14 @@ static const char *mainmenu[] = {
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
 	"[memstats] Virtual memory stats     ",
+	"[tlbstats] TLB statistics           ",
+	"[mig] Thread migration stats        ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock contention stats    ",
+#endif
+#if OPT_PAGING
+	"[faultaround] Fault-around pages    ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -568,6 +714,9 @@ static struct {
 	{ "cd",		cmd_chdir },
 	{ "pwd",	cmd_pwd },
 	{ "sync",	cmd_sync },
+#if OPT_PAGING
+	{ "swapon",	cmd_swapon },
+#endif
 	{ "panic",	cmd_panic },
 	{ "q",		cmd_quit },
 	{ "exit",	cmd_quit },
@@ -578,6 +727,14 @@ static struct {
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
     { "memstats",   cmd_memstats },
+    { "tlbstats",   cmd_tlbstats },
+	{ "mig",	cmd_migrate },
+#if OPT_LOCKSTAT
+	{ "lockstat",	cmd_lockstat },
+#endif
+#if OPT_PAGING
+	{ "faultaround", cmd_faultaround },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -590,6 +747,10 @@ static struct {
 	{ "km4",	kmalloctest4 },
 #if OPT_NET
 	{ "net",	nettest },
+#endif
+#if OPT_PAGING
+	{ "tlbp",	tlbpong },
+	{ "fcb",	framebench },
 #endif
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
@@ -598,8 +759,11 @@ static struct {
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
+	{ "lkb",	lockbench },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "rwt",	rwtest },
+	{ "rwb",	rwbench },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
@@ -632,6 +796,7 @@ static struct {
 	{ "fs4",	writestress2 },
 	{ "fs5",	longstress },
 	{ "fs6",	createstress },
+	{ "fs7",	readbench },
 
 	{ NULL, NULL }
 };
@@ -50,8 +50,10 @@
 #include <vnode.h>
 #include <synch.h>
 #include <limits.h>
+#include <vm.h>
 #include "opt-syscalls.h"
 #include "opt-waitpid.h"
+#include "opt-paging.h"
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -84,6 +86,7 @@ proc_create(const char *name)
 
 	proc->p_numthreads = 0;
 	spinlock_init(&proc->p_lock);
+	spinlock_setname(&proc->p_lock, "proc");
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
@@ -209,6 +212,9 @@ proc_destroy(struct proc *proc)
 			as = proc->p_addrspace;
 			proc->p_addrspace = NULL;
 		}
+#if OPT_PAGING
+		vm_faultstats(proc->p_name, as);
+#endif
 		as_destroy(as);
 	}
 
@@ -76,10 +76,22 @@ int sys_read(int fd, userptr_t buf, size_t size) {
     int result;
 
     kprintf("Reading fd n.%d... (%p)\n", fd, v);
-    uio_kinit(&iov, &u, buf, size, 0, UIO_READ);
+    /* a user buffer: may fault, so the fs bounces it (see sfs_lockedio) */
+    iov.iov_ubase = buf;
+    iov.iov_len = size;
+    u.uio_iov = &iov;
+    u.uio_iovcnt = 1;
+    u.uio_offset = 0;
+    u.uio_resid = size;
+    u.uio_segflg = UIO_USERSPACE;
+    u.uio_rw = UIO_READ;
+    u.uio_space = proc_getas();
 
     result = VOP_READ(v, &u);
-    return result;
+    if (result) {
+      return -1;
+    }
+    return size - u.uio_resid;
   }
   return -1;
 }
@@ -110,10 +122,21 @@ int sys_write(int fd, userptr_t buf, size_t nbytes) {
     int result;
 
     kprintf("Writing fd n.%d... (%p)\n", fd, v);
-    uio_kinit(&iov, &u, buf, nbytes, 0, UIO_WRITE);
+    iov.iov_ubase = buf;
+    iov.iov_len = nbytes;
+    u.uio_iov = &iov;
+    u.uio_iovcnt = 1;
+    u.uio_offset = 0;
+    u.uio_resid = nbytes;
+    u.uio_segflg = UIO_USERSPACE;
+    u.uio_rw = UIO_WRITE;
+    u.uio_space = proc_getas();
 
     result = VOP_WRITE(v, &u);
-    return result;
+    if (result) {
+      return -1;
+    }
+    return nbytes - u.uio_resid;
   }
   return -1;
 }
\ No newline at end of file
@@ -42,8 +42,9 @@
  * circumstances, as_prepare_load and as_complete_load probably don't
  * need to do anything.
  *
- * If you wanted to support memory-mapped executables you would need
- * to rearrange this to map each segment.
+ * Under the paging VM system segments are not read here at all:
+ * load_segment just tells the address space where each one lives in
+ * the file, and vm_fault reads pages in as the program touches them.
  *
  * To support dynamically linked executables with shared libraries
  * you'd need to change this to load the "ELF interpreter" (dynamic
@@ -57,9 +58,57 @@
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
+#include <stat.h>
 #include <vnode.h>
 #include <elf.h>
 
+#if !OPT_DUMBVM
+
+/*
+ * Map a segment at virtual address VADDR. The segment in memory
+ * extends from VADDR up to (but not including) VADDR+MEMSIZE. The
+ * segment on disk is located at file offset OFFSET and has length
+ * FILESIZE; the rest of it is zero-filled.
+ *
+ * as_define_region has already checked that the segment lies in user
+ * space.
+ */
+static
+int
+load_segment(struct addrspace *as, struct vnode *v,
+	     off_t offset, vaddr_t vaddr,
+	     size_t memsize, size_t filesize,
+	     int is_executable)
+{
+	struct stat st;
+	int result;
+
+	(void)is_executable;
+
+	if (filesize > memsize) {
+		kprintf("ELF: warning: segment filesize > segment memsize\n");
+		filesize = memsize;
+	}
+
+	DEBUG(DB_EXEC, "ELF: Mapping %lu bytes at 0x%lx\n",
+	      (unsigned long) filesize, (unsigned long) vaddr);
+
+	/* Catch truncated files now rather than at fault time. */
+	result = VOP_STAT(v, &st);
+	if (result) {
+		return result;
+	}
+	if (offset + filesize > st.st_size) {
+		kprintf("ELF: segment extends past end of file - "
+			"file truncated?\n");
+		return ENOEXEC;
+	}
+
+	return as_map_segment(as, vaddr, memsize, v, offset, filesize);
+}
+
+#else /* OPT_DUMBVM */
+
 /*
  * Load a segment at virtual address VADDR. The segment in memory
  * extends from VADDR up to (but not including) VADDR+MEMSIZE. The
@@ -145,6 +194,8 @@ load_segment(struct addrspace *as, struct vnode *v,
 	return result;
 }
 
+#endif /* OPT_DUMBVM */
+
 /*
  * Load an ELF executable user program into the current address space.
  *
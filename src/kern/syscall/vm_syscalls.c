@@ -0,0 +1,217 @@
+/*
+ * Memory-management system calls for the paging VM system.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/mman.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <lib.h>
+#include <limits.h>
+#include <copyinout.h>
+#include <proc.h>
+#include <current.h>
+#include <vnode.h>
+#include <addrspace.h>
+#include <syscall.h>
+#include <vmstat.h>
+#include "opt-syscalls.h"
+
+/*
+ * Look up file descriptor FD in the current process.
+ */
+static
+int
+vm_getfile(int fd, struct vnode **ret)
+{
+#if OPT_SYSCALLS
+	struct proc *p = curproc;
+
+	if (fd < 0 || fd >= OPEN_MAX || p->open_files == NULL ||
+	    p->open_files[fd] == NULL) {
+		return EBADF;
+	}
+	*ret = p->open_files[fd];
+	return 0;
+#else
+	(void)fd;
+	(void)ret;
+	return EBADF;
+#endif
+}
+
+/*
+ * sbrk: move the end of the heap by AMOUNT bytes and return where it
+ * used to be.
+ */
+int
+sys_sbrk(intptr_t amount, int32_t *retval)
+{
+	struct addrspace *as;
+	vaddr_t oldbrk;
+	int result;
+
+	as = proc_getas();
+	if (as == NULL) {
+		return ENOMEM;
+	}
+
+	result = as_sbrk(as, amount, &oldbrk);
+	if (result) {
+		return result;
+	}
+
+	*retval = (int32_t)oldbrk;
+	return 0;
+}
+
+/*
+ * mmap: map part of an open file. The fifth and sixth arguments (the
+ * file descriptor and the 64-bit offset) don't fit in registers and
+ * are fetched from the user stack, starting at ARGS (sp+16); the
+ * offset is 8-aligned, so it's at sp+24. The address hint is ignored,
+ * and so are the file descriptor and offset for MAP_ANON.
+ */
+int
+sys_mmap(userptr_t addr, size_t len, int prot, int flags, userptr_t args,
+	 int32_t *retval)
+{
+	struct addrspace *as;
+	struct vnode *v;
+	vaddr_t vaddr;
+	off_t offset;
+	int fd, result;
+
+	(void)addr;
+
+	result = copyin(args, &fd, sizeof(fd));
+	if (result) {
+		return result;
+	}
+	result = copyin(args + 8, &offset, sizeof(offset));
+	if (result) {
+		return result;
+	}
+
+	v = NULL;
+	if ((flags & MAP_ANON) == 0) {
+		result = vm_getfile(fd, &v);
+		if (result) {
+			return result;
+		}
+	}
+
+	as = proc_getas();
+	if (as == NULL) {
+		return ENOMEM;
+	}
+
+	result = as_mmap(as, len, prot, flags, v, offset, &vaddr);
+	if (result) {
+		return result;
+	}
+
+	*retval = (int32_t)vaddr;
+	return 0;
+}
+
+/*
+ * munmap: remove mappings made with mmap.
+ */
+int
+sys_munmap(userptr_t addr, size_t len)
+{
+	struct addrspace *as;
+
+	as = proc_getas();
+	if (as == NULL) {
+		return EINVAL;
+	}
+	return as_munmap(as, (vaddr_t)addr, len);
+}
+
+/*
+ * fsync: write back whatever the process changed through shared
+ * mappings of the file, then flush the file itself.
+ */
+int
+sys_fsync(int fd)
+{
+	struct addrspace *as;
+	struct vnode *v;
+	int result;
+
+	result = vm_getfile(fd, &v);
+	if (result) {
+		return result;
+	}
+
+	as = proc_getas();
+	if (as != NULL) {
+		result = as_sync(as, v);
+		if (result) {
+			return result;
+		}
+	}
+	return VOP_FSYNC(v);
+}
+
+/*
+ * vmstat: copy the VM statistics (see kern/vmstat.h) out to BUF.
+ */
+int
+sys_vmstat(userptr_t buf)
+{
+	struct vmstat vs;
+
+	vmstat_get(proc_getas(), &vs);
+	return copyout(&vs, buf, sizeof(vs));
+}
+
+/*
+ * getrlimit: the only limit there is is RLIMIT_STACK.
+ */
+int
+sys_getrlimit(int resource, userptr_t rlp)
+{
+	struct addrspace *as;
+	struct rlimit rl;
+
+	if (resource != RLIMIT_STACK) {
+		return EINVAL;
+	}
+	as = proc_getas();
+	if (as == NULL) {
+		return EINVAL;
+	}
+
+	rl.rlim_cur = as->as_stacklimit;
+	rl.rlim_max = as->as_stackmax;
+	return copyout(&rl, rlp, sizeof(rl));
+}
+
+/*
+ * setrlimit: set the stack limit; see as_setstacklimit.
+ */
+int
+sys_setrlimit(int resource, const_userptr_t rlp)
+{
+	struct addrspace *as;
+	struct rlimit rl;
+	int result;
+
+	if (resource != RLIMIT_STACK) {
+		return EINVAL;
+	}
+	result = copyin(rlp, &rl, sizeof(rl));
+	if (result) {
+		return result;
+	}
+	as = proc_getas();
+	if (as == NULL) {
+		return EINVAL;
+	}
+
+	return as_setstacklimit(as, rl.rlim_cur, rl.rlim_max);
+}
@@ -0,0 +1,115 @@
+/*
+ * framebench: frame allocator contention benchmark for the paging VM.
+ *
+ * FB_NTHREADS threads, spread over the cpus, each allocate FB_HOLD
+ * kernel pages, free them again, and repeat FB_LOOPS times. This is
+ * done twice: with single pages, which come out of the per-cpu frame
+ * caches, and with two-page runs, which always go to the buddy lists
+ * under coremap_lock. For each it reports the elapsed time and how
+ * often coremap_lock was taken and found held. With the caches
+ * working, the single-page run should take the lock about once per
+ * CM_BATCH frames and hardly ever have to wait for it.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <vm.h>
+#include <coremap.h>
+#include <test.h>
+
+#define FB_NTHREADS	8
+#define FB_LOOPS	2000
+#define FB_HOLD		4
+
+static struct semaphore *fb_done;
+static unsigned fb_npages;
+static unsigned fb_failures;
+
+static
+void
+fbthread(void *junk, unsigned long num)
+{
+	vaddr_t pages[FB_HOLD];
+	unsigned i, j;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<FB_LOOPS; i++) {
+		for (j=0; j<FB_HOLD; j++) {
+			pages[j] = alloc_kpages(fb_npages);
+			if (pages[j] == 0) {
+				fb_failures++;
+			}
+		}
+		for (j=0; j<FB_HOLD; j++) {
+			if (pages[j] != 0) {
+				free_kpages(pages[j]);
+			}
+		}
+	}
+	V(fb_done);
+}
+
+static
+void
+fb_run(unsigned npages)
+{
+	struct timespec before, after, duration;
+	unsigned long acq0, cont0, acq1, cont1, nallocs;
+	int i, result;
+
+	fb_npages = npages;
+	fb_failures = 0;
+
+	coremap_getlockstats(&acq0, &cont0);
+	gettime(&before);
+	for (i=0; i<FB_NTHREADS; i++) {
+		result = thread_fork("framebench", NULL, fbthread, NULL, i);
+		if (result) {
+			panic("framebench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<FB_NTHREADS; i++) {
+		P(fb_done);
+	}
+	gettime(&after);
+	coremap_getlockstats(&acq1, &cont1);
+	timespec_sub(&after, &before, &duration);
+
+	nallocs = (unsigned long)FB_NTHREADS * FB_LOOPS * FB_HOLD;
+	kprintf("%u page%s: %llu.%09lu seconds, %lu allocations, "
+		"%lu coremap lock acquisitions, %lu contended\n",
+		npages, npages == 1 ? ": " : "s:",
+		(unsigned long long)duration.tv_sec,
+		(unsigned long)duration.tv_nsec, nallocs,
+		acq1 - acq0, cont1 - cont0);
+	if (fb_failures > 0) {
+		kprintf("framebench: %u allocations failed\n", fb_failures);
+	}
+}
+
+int
+framebench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	fb_done = sem_create("framebench", 0);
+	if (fb_done == NULL) {
+		panic("framebench: sem_create failed\n");
+	}
+
+	kprintf("framebench: %d threads, %d allocations of %d each\n",
+		FB_NTHREADS, FB_LOOPS, FB_HOLD);
+	fb_run(1);
+	fb_run(2);
+
+	sem_destroy(fb_done);
+	kprintf("framebench done.\n");
+	return 0;
+}
@@ -48,6 +48,7 @@
 #include <vfs.h>
 #include <fs.h>
 #include <vnode.h>
+#include <clock.h>
 #include <test.h>
 
 #define SLOGAN   "HODIE MIHI - CRAS TIBI\n"
@@ -56,6 +57,9 @@
 #define NTHREADS 12
 #define NLONG    32
 #define NCREATE  24
+#define NREADBENCH     4
+#define READBENCHPASS  8
+#define READBENCHBUF   512
 
 static struct semaphore *threadsem = NULL;
 
@@ -674,6 +678,158 @@ docreatestress(const char *filesys)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Parallel read benchmark. Reads a set of files one after another,
+ * then all at once from separate threads, and reports both times.
+ * Each file is a separate vnode, so with per-vnode locking in the
+ * filesystem the parallel run should overlap its disk I/O and come
+ * out ahead; with one big lock it can't.
+ */
+
+static
+int
+readbench_file(const char *fs, const char *namesuffix)
+{
+	struct vnode *vn;
+	struct iovec iov;
+	struct uio ku;
+	char name[32];
+	char *buf;
+	off_t pos;
+	int i, err;
+
+	MAKENAME();
+
+	buf = kmalloc(READBENCHBUF);
+	if (buf == NULL) {
+		kprintf("%s: Out of memory\n", name);
+		return -1;
+	}
+
+	/* vfs_open destroys the string it's passed */
+	strcpy(buf, name);
+	err = vfs_open(buf, O_RDONLY, 0664, &vn);
+	if (err) {
+		kprintf("Could not open %s for read: %s\n",
+			name, strerror(err));
+		kfree(buf);
+		return -1;
+	}
+
+	for (i=0; i<READBENCHPASS; i++) {
+		pos = 0;
+		do {
+			uio_kinit(&iov, &ku, buf, READBENCHBUF, pos, UIO_READ);
+			err = VOP_READ(vn, &ku);
+			if (err) {
+				kprintf("%s: Read error: %s\n", name,
+					strerror(err));
+				vfs_close(vn);
+				kfree(buf);
+				return -1;
+			}
+			pos = ku.uio_offset;
+		} while (ku.uio_resid == 0);
+
+		if (pos != NCHUNKS*strlen(SLOGAN)) {
+			kprintf("%s: %lu bytes read, should have been %lu!\n",
+				name, (unsigned long) pos,
+				(unsigned long) (NCHUNKS*strlen(SLOGAN)));
+			vfs_close(vn);
+			kfree(buf);
+			return -1;
+		}
+	}
+
+	vfs_close(vn);
+	kfree(buf);
+	return 0;
+}
+
+static
+void
+readbench_thread(void *fs, unsigned long num)
+{
+	const char *filesys = fs;
+	char numstr[16];
+
+	snprintf(numstr, sizeof(numstr), "rb%lu", num);
+	if (readbench_file(filesys, numstr)) {
+		kprintf("*** Thread %lu: failed\n", num);
+	}
+	V(threadsem);
+}
+
+static
+void
+readbench_report(const char *what, struct timespec *before,
+		 struct timespec *after)
+{
+	struct timespec duration;
+
+	timespec_sub(after, before, &duration);
+	kprintf("%-10s %llu.%09lu seconds\n", what,
+		(unsigned long long)duration.tv_sec,
+		(unsigned long)duration.tv_nsec);
+}
+
+static
+void
+doreadbench(const char *filesys)
+{
+	struct timespec before, after;
+	char numstr[16];
+	int i, err;
+
+	init_threadsem();
+
+	kprintf("*** Starting fs parallel read benchmark on %s:\n", filesys);
+
+	for (i=0; i<NREADBENCH; i++) {
+		snprintf(numstr, sizeof(numstr), "rb%d", i);
+		if (fstest_write(filesys, numstr, 1, 0)) {
+			kprintf("*** Test failed\n");
+			goto cleanup;
+		}
+	}
+
+	gettime(&before);
+	for (i=0; i<NREADBENCH; i++) {
+		snprintf(numstr, sizeof(numstr), "rb%d", i);
+		if (readbench_file(filesys, numstr)) {
+			kprintf("*** Test failed\n");
+			goto cleanup;
+		}
+	}
+	gettime(&after);
+	readbench_report("serial", &before, &after);
+
+	gettime(&before);
+	for (i=0; i<NREADBENCH; i++) {
+		err = thread_fork("readbench", NULL,
+				  readbench_thread, (char *)filesys, i);
+		if (err) {
+			panic("readbench: thread_fork failed: %s\n",
+			      strerror(err));
+		}
+	}
+	for (i=0; i<NREADBENCH; i++) {
+		P(threadsem);
+	}
+	gettime(&after);
+	readbench_report("parallel", &before, &after);
+
+	kprintf("*** fs parallel read benchmark done\n");
+
+ cleanup:
+	for (i=0; i<NREADBENCH; i++) {
+		snprintf(numstr, sizeof(numstr), "rb%d", i);
+		fstest_remove(filesys, numstr);
+	}
+}
+
+////////////////////////////////////////////////////////////
+
 static
 int
 checkfilesystem(int nargs, char **args)
@@ -714,6 +870,7 @@ DEFTEST(writestress);
 DEFTEST(writestress2);
 DEFTEST(longstress);
 DEFTEST(createstress);
+DEFTEST(readbench);
 
 ////////////////////////////////////////////////////////////
 
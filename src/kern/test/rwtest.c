@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Reader-writer lock tests.
+ *
+ * rwtest is a stress test: readers check that the shared values are
+ * consistent and that no writer is inside while they are, writers
+ * check that they are alone. rwbench times a read-mostly table
+ * lookup workload under an rwlock and under a plain lock.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define RW_NREADERS     24
+#define RW_NWRITERS     8
+#define RW_NLOOPS       200
+
+static volatile unsigned long testval1;
+static volatile unsigned long testval2;
+static struct rwlock *testrw;
+static struct semaphore *donesem;
+
+/* Who is inside the lock right now; protected by statelock. */
+static struct spinlock statelock = SPINLOCK_INITIALIZER;
+static unsigned nreading;
+static unsigned nwriting;
+static unsigned maxreading;
+static bool rwfailed;
+
+static
+void
+rwfail(unsigned long num, const char *msg)
+{
+	kprintf("thread %lu: %s\n", num, msg);
+	spinlock_acquire(&statelock);
+	rwfailed = true;
+	spinlock_release(&statelock);
+}
+
+static
+void
+rwreaderthread(void *junk, unsigned long num)
+{
+	unsigned long v1, v2;
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<RW_NLOOPS; i++) {
+		rwlock_acquire_read(testrw);
+
+		spinlock_acquire(&statelock);
+		nreading++;
+		if (nreading > maxreading) {
+			maxreading = nreading;
+		}
+		if (nwriting != 0) {
+			spinlock_release(&statelock);
+			rwfail(num, "reader inside with a writer");
+			spinlock_acquire(&statelock);
+		}
+		spinlock_release(&statelock);
+
+		v1 = testval1;
+		thread_yield();
+		v2 = testval2;
+		if (v2 != v1 * v1) {
+			rwfail(num, "reader saw inconsistent values");
+		}
+
+		spinlock_acquire(&statelock);
+		nreading--;
+		spinlock_release(&statelock);
+
+		rwlock_release_read(testrw);
+	}
+	V(donesem);
+}
+
+static
+void
+rwwriterthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<RW_NLOOPS; i++) {
+		rwlock_acquire_write(testrw);
+		KASSERT(rwlock_do_i_hold_write(testrw));
+
+		spinlock_acquire(&statelock);
+		nwriting++;
+		if (nwriting != 1 || nreading != 0) {
+			spinlock_release(&statelock);
+			rwfail(num, "writer not alone");
+			spinlock_acquire(&statelock);
+		}
+		spinlock_release(&statelock);
+
+		testval1 = num + i;
+		thread_yield();
+		testval2 = (num + i) * (num + i);
+
+		spinlock_acquire(&statelock);
+		nwriting--;
+		spinlock_release(&statelock);
+
+		rwlock_release_write(testrw);
+		thread_yield();
+	}
+	V(donesem);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	testrw = rwlock_create("rwtest");
+	donesem = sem_create("rwdone", 0);
+	if (testrw == NULL || donesem == NULL) {
+		panic("rwtest: create failed\n");
+	}
+	testval1 = testval2 = 0;
+	nreading = nwriting = maxreading = 0;
+	rwfailed = false;
+
+	kprintf("Starting rwlock test...\n");
+	for (i=0; i<RW_NREADERS + RW_NWRITERS; i++) {
+		result = thread_fork("rwtest", NULL,
+				     i < RW_NREADERS ?
+				     rwreaderthread : rwwriterthread,
+				     NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<RW_NREADERS + RW_NWRITERS; i++) {
+		P(donesem);
+	}
+
+	kprintf("At most %u readers were inside at once.\n", maxreading);
+	kprintf("rwlock test %s.\n", rwfailed ? "FAILED" : "done");
+
+	rwlock_destroy(testrw);
+	sem_destroy(donesem);
+	testrw = NULL;
+	donesem = NULL;
+	return 0;
+}
+
+/*
+ * Benchmark: RB_NTHREADS threads look names up in a small table,
+ * changing an entry once every RB_WRITEEVERY lookups. With the table
+ * under a plain lock every lookup waits for every other one; with an
+ * rwlock lookups overlap, which shows on a multiprocessor.
+ */
+
+#define RB_NTHREADS     8
+#define RB_LOOPS        2000
+#define RB_TABLESIZE    16
+#define RB_WRITEEVERY   64
+
+static unsigned benchtable[RB_TABLESIZE];
+static struct rwlock *benchrw;
+static struct lock *benchlock;
+
+static
+unsigned
+rwbench_lookup(unsigned key)
+{
+	unsigned i;
+
+	for (i=0; i<RB_TABLESIZE; i++) {
+		if (benchtable[i] == key) {
+			return i;
+		}
+	}
+	return RB_TABLESIZE;
+}
+
+static
+void
+rwbenchthread(void *junk, unsigned long num)
+{
+	unsigned i;
+
+	(void)junk;
+
+	for (i=0; i<RB_LOOPS; i++) {
+		if (i % RB_WRITEEVERY == 0) {
+			if (benchrw != NULL) {
+				rwlock_acquire_write(benchrw);
+			}
+			else {
+				lock_acquire(benchlock);
+			}
+			benchtable[(num + i) % RB_TABLESIZE] = num + i;
+			if (benchrw != NULL) {
+				rwlock_release_write(benchrw);
+			}
+			else {
+				lock_release(benchlock);
+			}
+			continue;
+		}
+
+		if (benchrw != NULL) {
+			rwlock_acquire_read(benchrw);
+			(void)rwbench_lookup(num + i);
+			rwlock_release_read(benchrw);
+		}
+		else {
+			lock_acquire(benchlock);
+			(void)rwbench_lookup(num + i);
+			lock_release(benchlock);
+		}
+	}
+	V(donesem);
+}
+
+static
+void
+rwbench_run(const char *what)
+{
+	struct timespec before, after, duration;
+	uint64_t ns, total;
+	int i, result;
+
+	gettime(&before);
+	for (i=0; i<RB_NTHREADS; i++) {
+		result = thread_fork("rwbench", NULL, rwbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("rwbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<RB_NTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&after);
+	timespec_sub(&after, &before, &duration);
+
+	ns = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	total = (uint64_t)RB_NTHREADS * RB_LOOPS;
+	kprintf("%-8s %llu.%09lu seconds, %llu ns per operation\n", what,
+		(unsigned long long)duration.tv_sec,
+		(unsigned long)duration.tv_nsec,
+		(unsigned long long)(ns / total));
+}
+
+int
+rwbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	donesem = sem_create("rwdone", 0);
+	benchlock = lock_create("rwbench");
+	if (donesem == NULL || benchlock == NULL) {
+		panic("rwbench: create failed\n");
+	}
+
+	kprintf("rwbench: %d threads, %d operations each, "
+		"1 in %d a write\n", RB_NTHREADS, RB_LOOPS, RB_WRITEEVERY);
+
+	benchrw = NULL;
+	rwbench_run("lock:");
+
+	benchrw = rwlock_create("rwbench");
+	if (benchrw == NULL) {
+		panic("rwbench: rwlock_create failed\n");
+	}
+	rwbench_run("rwlock:");
+
+	rwlock_destroy(benchrw);
+	benchrw = NULL;
+	lock_destroy(benchlock);
+	benchlock = NULL;
+	sem_destroy(donesem);
+	donesem = NULL;
+	kprintf("rwbench done.\n");
+	return 0;
+}
@@ -220,6 +220,107 @@ locktest(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Lock benchmark: LB_NTHREADS threads take turns on one lock, holding
+ * it for a short critical section each time, and we time how long
+ * LB_LOOPS acquisitions each take. With adaptive locks it runs twice,
+ * first with spinning turned off, so the two can be compared on a
+ * multiprocessor.
+ */
+
+#define LB_NTHREADS   8
+#define LB_LOOPS      2000
+#define LB_HOLD       50        /* busy-loop iterations in the lock */
+#define LB_THINK      200       /* ...and outside it */
+
+static struct lock *benchlock;
+
+static
+void
+lockbenchthread(void *junk, unsigned long num)
+{
+	volatile int j;
+	int i;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<LB_LOOPS; i++) {
+		lock_acquire(benchlock);
+		for (j=0; j<LB_HOLD; j++);
+		lock_release(benchlock);
+		for (j=0; j<LB_THINK; j++);
+	}
+	V(donesem);
+}
+
+static
+void
+lockbench_run(const char *what)
+{
+	struct timespec before, after, duration;
+	uint64_t ns, total;
+	int i, result;
+
+	gettime(&before);
+	for (i=0; i<LB_NTHREADS; i++) {
+		result = thread_fork("lockbench", NULL, lockbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("lockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<LB_NTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&after);
+	timespec_sub(&after, &before, &duration);
+
+	ns = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	total = (uint64_t)LB_NTHREADS * LB_LOOPS;
+	kprintf("%-10s %llu.%09lu seconds, %llu ns per acquire, "
+		"%llu acquires/sec\n", what,
+		(unsigned long long)duration.tv_sec,
+		(unsigned long)duration.tv_nsec,
+		(unsigned long long)(ns / total),
+		(unsigned long long)(ns > 0 ? total * 1000000000ULL / ns : 0));
+}
+
+int
+lockbench(int nargs, char **args)
+{
+#if OPT_ADAPTIVELOCK
+	unsigned spinmax;
+#endif
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	benchlock = lock_create("lockbench");
+	if (benchlock == NULL) {
+		panic("lockbench: lock_create failed\n");
+	}
+
+	kprintf("lockbench: %d threads, %d acquires each\n",
+		LB_NTHREADS, LB_LOOPS);
+#if OPT_ADAPTIVELOCK
+	spinmax = lock_spinmax;
+	lock_spinmax = 0;
+	lockbench_run("sleeping:");
+	lock_spinmax = spinmax;
+	lockbench_run("adaptive:");
+#else
+	lockbench_run("lock:");
+#endif
+
+	lock_destroy(benchlock);
+	benchlock = NULL;
+	kprintf("lockbench done.\n");
+	return 0;
+}
+
 static
 void
 cvtestthread(void *junk, unsigned long num)
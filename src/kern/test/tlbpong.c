@@ -0,0 +1,208 @@
+/*
+ * tlbpong: context switch benchmark for the paging VM, in the spirit
+ * of the schedpong userland test.
+ *
+ * PONG_NPROCS processes, each with its own address space, pass a
+ * token around a ring of semaphores. Whoever holds the token writes
+ * to each of its PONG_NPAGES pages and passes it on, so every round
+ * is PONG_NPROCS context switches between address spaces. All the
+ * pages together fit in the TLB.
+ *
+ * The ring is run twice: once as the VM normally works, where the
+ * ASID tags keep each process's translations in the TLB across
+ * switches, and once flushing the whole TLB after every switch the
+ * way as_activate used to. The difference in TLB misses and elapsed
+ * time is the cost of the flushes.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <thread.h>
+#include <proc.h>
+#include <current.h>
+#include <synch.h>
+#include <copyinout.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <test.h>
+
+#define PONG_NPROCS	4
+#define PONG_NPAGES	8
+#define PONG_ROUNDS	2000
+#define PONG_VBASE	0x10000000
+
+static struct semaphore *pong_sems[PONG_NPROCS];
+static struct semaphore *pong_done;
+static bool pong_flush;
+static int pong_err;
+
+static
+unsigned
+pong_tlbmisses(void)
+{
+	unsigned i, n, total;
+
+	total = 0;
+	n = cpu_count();
+	for (i=0; i<n; i++) {
+		total += cpu_get(i)->c_tlb_misses;
+	}
+	return total;
+}
+
+static
+void
+pongthread(void *junk, unsigned long num)
+{
+	struct addrspace *as;
+	uint32_t word;
+	int i, j, result;
+
+	(void)junk;
+
+	as = as_create();
+	if (as == NULL) {
+		pong_err = ENOMEM;
+	}
+	else {
+		proc_setas(as);
+		as_activate();
+		result = as_define_region(as, PONG_VBASE,
+					  PONG_NPAGES * PAGE_SIZE, 1, 1, 0);
+		if (result) {
+			pong_err = result;
+		}
+	}
+
+	/*
+	 * Keep passing the token even if setup failed, so the other
+	 * threads don't hang; copyout will just fail.
+	 */
+	for (i=0; i<PONG_ROUNDS; i++) {
+		P(pong_sems[num]);
+		if (pong_flush) {
+			vm_tlbflush();
+		}
+		for (j=0; j<PONG_NPAGES; j++) {
+			word = i;
+			result = copyout(&word,
+				(userptr_t)(PONG_VBASE + j * PAGE_SIZE),
+				sizeof(word));
+			if (result) {
+				pong_err = result;
+			}
+		}
+		V(pong_sems[(num + 1) % PONG_NPROCS]);
+	}
+
+	if (as != NULL) {
+		as = proc_setas(NULL);
+		as_deactivate();
+		as_destroy(as);
+	}
+
+	/* Detach now so our proc can be destroyed once we signal. */
+	proc_remthread(curthread);
+	V(pong_done);
+}
+
+static
+int
+pong_run(bool flush)
+{
+	struct proc *procs[PONG_NPROCS];
+	struct timespec before, after, duration;
+	unsigned misses;
+	int i, result;
+
+	pong_flush = flush;
+	pong_err = 0;
+
+	for (i=0; i<PONG_NPROCS; i++) {
+		procs[i] = proc_create_runprogram("tlbpong");
+		if (procs[i] == NULL) {
+			panic("tlbpong: proc_create_runprogram failed\n");
+		}
+	}
+
+	misses = pong_tlbmisses();
+	gettime(&before);
+
+	for (i=0; i<PONG_NPROCS; i++) {
+		result = thread_fork("tlbpong", procs[i], pongthread,
+				     NULL, i);
+		if (result) {
+			panic("tlbpong: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	V(pong_sems[0]);
+	for (i=0; i<PONG_NPROCS; i++) {
+		P(pong_done);
+	}
+
+	gettime(&after);
+	misses = pong_tlbmisses() - misses;
+	timespec_sub(&after, &before, &duration);
+
+	/* Take back the token the last thread passed on. */
+	P(pong_sems[0]);
+
+	for (i=0; i<PONG_NPROCS; i++) {
+		proc_destroy(procs[i]);
+	}
+
+	kprintf("%-12s %llu.%09lu seconds, %u TLB misses "
+		"(%u per switch)\n", flush ? "flush:" : "ASID tags:",
+		(unsigned long long)duration.tv_sec,
+		(unsigned long)duration.tv_nsec, misses,
+		misses / (PONG_ROUNDS * PONG_NPROCS));
+
+	if (pong_err) {
+		kprintf("tlbpong: touching user pages failed: %s\n",
+			strerror(pong_err));
+	}
+	return pong_err;
+}
+
+int
+tlbpong(int nargs, char **args)
+{
+	char name[32];
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	for (i=0; i<PONG_NPROCS; i++) {
+		snprintf(name, sizeof(name), "tlbpong %d", i);
+		pong_sems[i] = sem_create(name, 0);
+		if (pong_sems[i] == NULL) {
+			panic("tlbpong: sem_create failed\n");
+		}
+	}
+	pong_done = sem_create("tlbpong done", 0);
+	if (pong_done == NULL) {
+		panic("tlbpong: sem_create failed\n");
+	}
+
+	kprintf("tlbpong: %d processes, %d pages each, %d rounds\n",
+		PONG_NPROCS, PONG_NPAGES, PONG_ROUNDS);
+
+	result = pong_run(false);
+	if (result == 0) {
+		result = pong_run(true);
+	}
+
+	sem_destroy(pong_done);
+	for (i=0; i<PONG_NPROCS; i++) {
+		sem_destroy(pong_sems[i]);
+	}
+
+	kprintf("tlbpong: %s\n", result ? "FAILED" : "done");
+	return result;
+}
@@ -0,0 +1,256 @@
+/*
+ * Lock contention statistics.
+ *
+ * The records live in a fixed table, because lockstat_get is called
+ * from lock_create and spinlock_setname, which may run with
+ * spinlocks held or before kmalloc is usable. Records are never
+ * freed: a lock's numbers outlive the lock, which is what we want
+ * for locks that come and go, like per-process ones.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <clock.h>
+#include <membar.h>
+#include <spinlock.h>
+#include <lockstat.h>
+
+static struct lockstat lockstats[LOCKSTAT_MAX];
+static unsigned nlockstats;
+
+/* Catch-alls. */
+static struct lockstat lockstat_unnamed = { "(unnamed)", LOCKSTAT_SPIN,
+					    SPINLOCK_DATA_INITIALIZER,
+					    0, 0, 0, 0 };
+static struct lockstat lockstat_otherspin = { "(other)", LOCKSTAT_SPIN,
+					      SPINLOCK_DATA_INITIALIZER,
+					      0, 0, 0, 0 };
+static struct lockstat lockstat_othersleep = { "(other)", LOCKSTAT_SLEEP,
+					       SPINLOCK_DATA_INITIALIZER,
+					       0, 0, 0, 0 };
+
+/*
+ * Protects the table itself (nlockstats and the names), not the
+ * counters. It has no name, so acquiring it only ever touches
+ * lockstat_unnamed.
+ */
+static struct spinlock lockstats_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Lock and unlock a record's counters. The caller must have
+ * interrupts off; see lockstat.h.
+ */
+static
+void
+lockstat_lock(struct lockstat *st)
+{
+	while (spinlock_data_get(&st->ls_lock) != 0 ||
+	       spinlock_data_testandset(&st->ls_lock) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+}
+
+static
+void
+lockstat_unlock(struct lockstat *st)
+{
+	membar_any_store();
+	spinlock_data_set(&st->ls_lock, 0);
+}
+
+struct lockstat *
+lockstat_get(const char *name, unsigned kind)
+{
+	char shortname[LOCKSTAT_NAMELEN];
+	struct lockstat *st;
+	unsigned i;
+
+	KASSERT(kind == LOCKSTAT_SPIN || kind == LOCKSTAT_SLEEP);
+
+	snprintf(shortname, sizeof(shortname), "%s", name);
+
+	spinlock_acquire(&lockstats_lock);
+	for (i=0; i<nlockstats; i++) {
+		st = &lockstats[i];
+		if (st->ls_kind == kind &&
+		    !strcmp(st->ls_name, shortname)) {
+			spinlock_release(&lockstats_lock);
+			return st;
+		}
+	}
+	if (nlockstats == LOCKSTAT_MAX) {
+		spinlock_release(&lockstats_lock);
+		return kind == LOCKSTAT_SPIN ?
+			&lockstat_otherspin : &lockstat_othersleep;
+	}
+	st = &lockstats[nlockstats++];
+	strcpy(st->ls_name, shortname);
+	st->ls_kind = kind;
+	spinlock_release(&lockstats_lock);
+	return st;
+}
+
+void
+lockstat_spin(struct lockstat *st, unsigned spins)
+{
+	if (st == NULL) {
+		st = &lockstat_unnamed;
+	}
+	lockstat_lock(st);
+	st->ls_acquires++;
+	if (spins > 0) {
+		st->ls_contended++;
+		st->ls_spins += spins;
+	}
+	lockstat_unlock(st);
+}
+
+void
+lockstat_sleep(struct lockstat *st, bool contended, unsigned spins,
+	       const struct timespec *before, const struct timespec *after)
+{
+	struct timespec slept;
+	uint64_t ns = 0;
+
+	KASSERT(st != NULL);
+
+	if (before != NULL) {
+		timespec_sub(after, before, &slept);
+		ns = slept.tv_sec * 1000000000ULL + slept.tv_nsec;
+	}
+
+	lockstat_lock(st);
+	st->ls_acquires++;
+	if (contended) {
+		st->ls_contended++;
+	}
+	st->ls_spins += spins;
+	st->ls_sleepns += ns;
+	lockstat_unlock(st);
+}
+
+/*
+ * Copy a record's counters all at once, so the 64-bit ones don't
+ * tear.
+ */
+static
+void
+lockstat_copy(struct lockstat *st, struct lockstat *copy)
+{
+	int spl;
+
+	spl = splhigh();
+	lockstat_lock(st);
+	*copy = *st;
+	lockstat_unlock(st);
+	splx(spl);
+}
+
+/*
+ * Order by contended acquires, then by time spent waiting.
+ */
+static
+bool
+lockstat_worse(const struct lockstat *a, const struct lockstat *b)
+{
+	if (a->ls_contended != b->ls_contended) {
+		return a->ls_contended > b->ls_contended;
+	}
+	if (a->ls_sleepns != b->ls_sleepns) {
+		return a->ls_sleepns > b->ls_sleepns;
+	}
+	return a->ls_spins > b->ls_spins;
+}
+
+void
+lockstat_print(unsigned max)
+{
+	struct lockstat *copies;
+	struct lockstat *sorted[LOCKSTAT_MAX + 3];
+	struct lockstat *st;
+	unsigned i, j, n;
+
+	/* Records only get added, so a snapshot of the count is safe. */
+	spinlock_acquire(&lockstats_lock);
+	n = nlockstats;
+	spinlock_release(&lockstats_lock);
+
+	/* Sort and print copies, so the numbers hold still. */
+	copies = kmalloc((n + 3) * sizeof(*copies));
+	if (copies == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+	for (i=0; i<n; i++) {
+		lockstat_copy(&lockstats[i], &copies[i]);
+	}
+	lockstat_copy(&lockstat_unnamed, &copies[n++]);
+	lockstat_copy(&lockstat_otherspin, &copies[n++]);
+	lockstat_copy(&lockstat_othersleep, &copies[n++]);
+	for (i=0; i<n; i++) {
+		sorted[i] = &copies[i];
+	}
+
+	/* Insertion sort; n is small and this is not a hot path. */
+	for (i=1; i<n; i++) {
+		st = sorted[i];
+		for (j=i; j>0 && lockstat_worse(st, sorted[j-1]); j--) {
+			sorted[j] = sorted[j-1];
+		}
+		sorted[j] = st;
+	}
+
+	kprintf("%-24s %5s %10s %10s %12s %12s\n", "lock", "kind",
+		"acquires", "contended", "spins", "sleep (us)");
+	for (i=0; i<n && i<max; i++) {
+		st = sorted[i];
+		if (st->ls_contended == 0) {
+			break;
+		}
+		kprintf("%-24s %5s %10u %10u %12llu %12llu\n",
+			st->ls_name,
+			st->ls_kind == LOCKSTAT_SPIN ? "spin" : "sleep",
+			st->ls_acquires, st->ls_contended,
+			(unsigned long long)st->ls_spins,
+			(unsigned long long)(st->ls_sleepns / 1000));
+	}
+	if (i == 0) {
+		kprintf("(no contended locks)\n");
+	}
+	kfree(copies);
+}
+
+static
+void
+lockstat_zero(struct lockstat *st)
+{
+	int spl;
+
+	spl = splhigh();
+	lockstat_lock(st);
+	st->ls_acquires = 0;
+	st->ls_contended = 0;
+	st->ls_spins = 0;
+	st->ls_sleepns = 0;
+	lockstat_unlock(st);
+	splx(spl);
+}
+
+void
+lockstat_reset(void)
+{
+	unsigned i, n;
+
+	spinlock_acquire(&lockstats_lock);
+	n = nlockstats;
+	spinlock_release(&lockstats_lock);
+
+	for (i=0; i<n; i++) {
+		lockstat_zero(&lockstats[i]);
+	}
+	lockstat_zero(&lockstat_unnamed);
+	lockstat_zero(&lockstat_otherspin);
+	lockstat_zero(&lockstat_othersleep);
+}
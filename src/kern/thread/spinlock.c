@@ -38,6 +38,7 @@
 #include <spinlock.h>
 #include <membar.h>
 #include <current.h>	/* for curcpu */
+#include <lockstat.h>
 
 /*
  * Spinlocks.
@@ -51,9 +52,26 @@ void
 spinlock_init(struct spinlock *splk)
 {
 	spinlock_data_set(&splk->splk_lock, 0);
+#if OPT_FIFOSYNC
+	spinlock_data_set(&splk->splk_next, 0);
+#endif
 	splk->splk_holder = NULL;
+#if OPT_LOCKSTAT
+	splk->splk_stat = NULL;
+#endif
 }
 
+#if OPT_LOCKSTAT
+/*
+ * Give the spinlock a name to be counted under.
+ */
+void
+spinlock_setname(struct spinlock *splk, const char *name)
+{
+	splk->splk_stat = lockstat_get(name, LOCKSTAT_SPIN);
+}
+#endif
+
 /*
  * Clean up spinlock.
  */
@@ -61,7 +79,12 @@ void
 spinlock_cleanup(struct spinlock *splk)
 {
 	KASSERT(splk->splk_holder == NULL);
+#if OPT_FIFOSYNC
+	KASSERT(spinlock_data_get(&splk->splk_lock) ==
+		spinlock_data_get(&splk->splk_next));
+#else
 	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+#endif
 }
 
 /*
@@ -75,6 +98,12 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+#if OPT_FIFOSYNC
+	spinlock_data_t ticket;
+#endif
+#if OPT_LOCKSTAT
+	unsigned spins = 0;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -90,6 +119,16 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
+#if OPT_FIFOSYNC
+	/* Take a ticket and wait for our turn. */
+	ticket = spinlock_data_fetchandinc(&splk->splk_next);
+	while (spinlock_data_get(&splk->splk_lock) != ticket) {
+		/* spin */
+#if OPT_LOCKSTAT
+		spins++;
+#endif
+	}
+#else
 	while (1) {
 		/*
 		 * Do test-test-and-set, that is, read first before
@@ -101,17 +140,72 @@ spinlock_acquire(struct spinlock *splk)
 		 * previously unheld and we now own it. If it was 1,
 		 * we don't.
 		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
-		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
+		if (spinlock_data_get(&splk->splk_lock) != 0 ||
+		    spinlock_data_testandset(&splk->splk_lock) != 0) {
+#if OPT_LOCKSTAT
+			spins++;
+#endif
 			continue;
 		}
 		break;
 	}
+#endif
+
+	membar_store_any();
+	splk->splk_holder = mycpu;
+#if OPT_LOCKSTAT
+	lockstat_spin(splk->splk_stat, spins);
+#endif
+}
+
+/*
+ * Get the lock if it's free, without spinning.
+ */
+bool
+spinlock_tryacquire(struct spinlock *splk)
+{
+	struct cpu *mycpu;
+#if OPT_FIFOSYNC
+	spinlock_data_t serving;
+#endif
 
+	splraise(IPL_NONE, IPL_HIGH);
+
+	/* this must work before curcpu initialization */
+	if (CURCPU_EXISTS()) {
+		mycpu = curcpu->c_self;
+		if (splk->splk_holder == mycpu) {
+			panic("Deadlock on spinlock %p\n", splk);
+		}
+	}
+	else {
+		mycpu = NULL;
+	}
+
+#if OPT_FIFOSYNC
+	/* Only if nobody is holding or waiting: take the next ticket. */
+	serving = spinlock_data_get(&splk->splk_lock);
+	if (!spinlock_data_cas(&splk->splk_next, serving, serving + 1)) {
+		spllower(IPL_HIGH, IPL_NONE);
+		return false;
+	}
+#else
+	if (spinlock_data_get(&splk->splk_lock) != 0 ||
+	    spinlock_data_testandset(&splk->splk_lock) != 0) {
+		spllower(IPL_HIGH, IPL_NONE);
+		return false;
+	}
+#endif
+
+	if (mycpu != NULL) {
+		mycpu->c_spinlocks++;
+	}
 	membar_store_any();
 	splk->splk_holder = mycpu;
+#if OPT_LOCKSTAT
+	lockstat_spin(splk->splk_stat, 0);
+#endif
+	return true;
 }
 
 /*
@@ -129,7 +223,13 @@ spinlock_release(struct spinlock *splk)
 
 	splk->splk_holder = NULL;
 	membar_any_store();
+#if OPT_FIFOSYNC
+	/* Only the holder writes this, so no atomic op is needed. */
+	spinlock_data_set(&splk->splk_lock,
+			  spinlock_data_get(&splk->splk_lock) + 1);
+#else
 	spinlock_data_set(&splk->splk_lock, 0);
+#endif
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -37,11 +37,16 @@
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
+#include <cpu.h>
 #include <current.h>
 #include <synch.h>
+#include <clock.h>
+#include <lockstat.h>
 
 #include "opt-semlock.h"
 #include "opt-wchanlock.h"
+#include "opt-adaptivelock.h"
+#include "opt-lockstat.h"
 #include "opt-condvars.h"
 
 ////////////////////////////////////////////////////////////
@@ -72,6 +77,7 @@ sem_create(const char *name, unsigned initial_count)
 	}
 
 	spinlock_init(&sem->sem_lock);
+	spinlock_setname(&sem->sem_lock, name);
         sem->sem_count = initial_count;
 
         return sem;
@@ -104,6 +110,20 @@ P(struct semaphore *sem)
 
 	/* Use the semaphore spinlock to protect the wchan as well. */
 	spinlock_acquire(&sem->sem_lock);
+#if OPT_FIFOSYNC
+	/*
+	 * Strict FIFO: V never raises the count while anyone is
+	 * waiting, it wakes the oldest waiter instead and that thread
+	 * owns the unit V gave up. So a nonzero count means nobody is
+	 * queued and we can take it; otherwise we queue at the tail.
+	 */
+	if (sem->sem_count > 0) {
+		sem->sem_count--;
+	}
+	else {
+		wchan_sleep(sem->sem_wchan, &sem->sem_lock);
+	}
+#else
         while (sem->sem_count == 0) {
 		/*
 		 *
@@ -114,13 +134,13 @@ P(struct semaphore *sem)
 		 * textbooks semaphores must for some reason have
 		 * strict ordering. Too bad. :-)
 		 *
-		 * Exercise: how would you implement strict FIFO
-		 * ordering?
+		 * (With options fifosync we do; see above.)
 		 */
 		wchan_sleep(sem->sem_wchan, &sem->sem_lock);
         }
         KASSERT(sem->sem_count > 0);
         sem->sem_count--;
+#endif
 	spinlock_release(&sem->sem_lock);
 }
 
@@ -131,9 +151,21 @@ V(struct semaphore *sem)
 
 	spinlock_acquire(&sem->sem_lock);
 
+#if OPT_FIFOSYNC
+	if (!wchan_isempty(sem->sem_wchan, &sem->sem_lock)) {
+		/* Hand the count to the oldest waiter. */
+		KASSERT(sem->sem_count == 0);
+		wchan_wakeone(sem->sem_wchan, &sem->sem_lock);
+	}
+	else {
+		sem->sem_count++;
+		KASSERT(sem->sem_count > 0);
+	}
+#else
         sem->sem_count++;
         KASSERT(sem->sem_count > 0);
 	wchan_wakeone(sem->sem_wchan, &sem->sem_lock);
+#endif
 
 	spinlock_release(&sem->sem_lock);
 }
@@ -142,6 +174,78 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+#if OPT_WCHANLOCK || OPT_ADAPTIVELOCK
+/*
+ * True if LOCK can be taken right now: nobody owns it and it has not
+ * been handed off to a waiter that hasn't run yet.
+ */
+static
+bool
+lock_isfree(struct lock *lock)
+{
+#if OPT_FIFOSYNC
+        return lock->lk_owner == NULL && !lock->lk_handoff;
+#else
+        return lock->lk_owner == NULL;
+#endif
+}
+#endif
+
+#if OPT_ADAPTIVELOCK
+unsigned lock_spinmax = LOCK_SPINMAX;
+
+/*
+ * True if OWNER, which took LOCK, is running on some other cpu right
+ * now. Once we drop the spinlock OWNER may release the lock, exit and
+ * be freed at any moment, so it is only compared, never dereferenced:
+ * we look at what the cpu it took the lock on is running instead.
+ * Cpus are never freed. The answer is only a hint; if OWNER has moved
+ * to another cpu since, we just stop spinning and sleep.
+ */
+static
+bool
+lock_owner_running(struct lock *lock, struct thread *owner)
+{
+        struct cpu *c = lock->lk_ownercpu;
+
+        return c != NULL && c != curcpu->c_self && c->c_curthread == owner;
+}
+
+/*
+ * LOCK is held. If its owner is running elsewhere, wait (with the
+ * spinlock dropped) for it to let go, giving up after lock_spinmax
+ * polls or once the owner is off the cpu. Returns true if the lock
+ * is free when we get the spinlock back. The polls are added to
+ * *SPINS.
+ */
+static
+bool
+lock_spin(struct lock *lock, unsigned *spins)
+{
+        struct thread *owner;
+        unsigned i;
+
+        KASSERT(spinlock_do_i_hold(&lock->wchan_spinlk));
+
+        owner = lock->lk_owner;
+        if (owner == NULL || !lock_owner_running(lock, owner)) {
+                return lock_isfree(lock);
+        }
+
+        spinlock_release(&lock->wchan_spinlk);
+        for (i=0; i<lock_spinmax; i++) {
+                if (lock->lk_owner != owner ||
+                    !lock_owner_running(lock, owner)) {
+                        break;
+                }
+        }
+        spinlock_acquire(&lock->wchan_spinlk);
+        *spins += i;
+
+        return lock_isfree(lock);
+}
+#endif
+
 struct lock *
 lock_create(const char *name)
 {
@@ -162,9 +266,19 @@ lock_create(const char *name)
 #if OPT_SEMLOCK
         lock->lk_sem = sem_create(name, 1);
         lock->lk_owner = NULL;
-#elif OPT_WCHANLOCK
+#elif OPT_WCHANLOCK || OPT_ADAPTIVELOCK
         lock->lk_owner = NULL;
+#if OPT_ADAPTIVELOCK
+        lock->lk_ownercpu = NULL;
+#endif
+#if OPT_FIFOSYNC
+        lock->lk_handoff = false;
+#endif
+#if OPT_LOCKSTAT
+        lock->lk_stat = lockstat_get(name, LOCKSTAT_SLEEP);
+#endif
         spinlock_init(&lock->wchan_spinlk);
+        spinlock_setname(&lock->wchan_spinlk, name);
         lock->lk_wchan = wchan_create(lock->lk_name);
 #endif
         return lock;
@@ -179,7 +293,7 @@ lock_destroy(struct lock *lock)
 #if OPT_SEMLOCK
         sem_destroy(lock->lk_sem);
         kfree(lock->lk_owner);
-#elif OPT_WCHANLOCK
+#elif OPT_WCHANLOCK || OPT_ADAPTIVELOCK
         spinlock_cleanup(&lock->wchan_spinlk);
         wchan_destroy(lock->lk_wchan);
 #endif
@@ -191,6 +305,17 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
+#if OPT_SEMLOCK
+#elif OPT_WCHANLOCK || OPT_ADAPTIVELOCK
+#if OPT_ADAPTIVELOCK || OPT_LOCKSTAT
+        unsigned spins = 0;
+#endif
+#if OPT_LOCKSTAT
+        struct timespec before, after;
+        bool contended, slept;
+#endif
+#endif
+
         // Write this
 #if OPT_SEMLOCK
 
@@ -198,7 +323,7 @@ lock_acquire(struct lock *lock)
           P(lock->lk_sem);
           lock->lk_owner = curthread;
         }
-#elif OPT_WCHANLOCK
+#elif OPT_WCHANLOCK || OPT_ADAPTIVELOCK
         /* 0) check owner and acquire spinlock
          * 1) test lock_count -> se 0 wait channel
          *                    -> se 1 lock spinlock
@@ -206,12 +331,43 @@ lock_acquire(struct lock *lock)
          * 3) release spinlock
          * */
         spinlock_acquire(&lock->wchan_spinlk);
-        while (lock->lk_owner != NULL) {
+#if OPT_LOCKSTAT
+        contended = !lock_isfree(lock);
+        slept = false;
+#endif
+        while (!lock_isfree(lock)) {
+#if OPT_ADAPTIVELOCK
+          if (lock_spin(lock, &spins)) {
+            break;
+          }
+#endif
+#if OPT_LOCKSTAT
+          if (!slept) {
+            gettime(&before);
+            slept = true;
+          }
+#endif
           wchan_sleep(lock->lk_wchan, &lock->wchan_spinlk);
+#if OPT_LOCKSTAT
+          gettime(&after);
+#endif
+#if OPT_FIFOSYNC
+          /* lock_release woke us and passed the lock on to us. */
+          KASSERT(lock->lk_handoff);
+          lock->lk_handoff = false;
+          break;
+#endif
         }
         KASSERT(lock->lk_owner == NULL);
 
         lock->lk_owner = curthread;
+#if OPT_ADAPTIVELOCK
+        lock->lk_ownercpu = curcpu->c_self;
+#endif
+#if OPT_LOCKSTAT
+        lockstat_sleep(lock->lk_stat, contended, spins,
+                       slept ? &before : NULL, slept ? &after : NULL);
+#endif
         spinlock_release(&lock->wchan_spinlk);
 #else
         (void)lock;  // suppress warning until code gets written
@@ -229,7 +385,7 @@ lock_release(struct lock *lock)
       lock->lk_owner = NULL;
       V(lock->lk_sem);
 
-#elif OPT_WCHANLOCK
+#elif OPT_WCHANLOCK || OPT_ADAPTIVELOCK
       /* 0) check owner
        * 1) lock spinlock
        * 2) release
@@ -240,6 +396,11 @@ lock_release(struct lock *lock)
       spinlock_acquire(&lock->wchan_spinlk);
       lock->lk_owner = NULL;
       KASSERT(lock->lk_owner == NULL);
+#if OPT_FIFOSYNC
+      if (!wchan_isempty(lock->lk_wchan, &lock->wchan_spinlk)) {
+        lock->lk_handoff = true;
+      }
+#endif
       wchan_wakeone(lock->lk_wchan, &lock->wchan_spinlk);
       spinlock_release(&lock->wchan_spinlk);
 #else
@@ -251,7 +412,7 @@ bool
 lock_do_i_hold(struct lock *lock)
 {
         // Write this
-#if OPT_SEMLOCK || OPT_WCHANLOCK
+#if OPT_SEMLOCK || OPT_WCHANLOCK || OPT_ADAPTIVELOCK
         if (lock == NULL || (lock->lk_owner == curthread)) {
           return true;
         }
@@ -293,6 +454,7 @@ cv_create(const char *name)
           return NULL;
         }
         spinlock_init(&cv->wc_spin);
+        spinlock_setname(&cv->wc_spin, name);
 #endif
         return cv;
 }
@@ -333,7 +495,7 @@ void
 cv_signal(struct cv *cv, struct lock *lock)
 {
 #ifdef OPT_CONDVARS
-        KASSERT(lock->lk_owner == curthread);
+        KASSERT(lock_do_i_hold(lock));
         spinlock_acquire(&cv->wc_spin);
         wchan_wakeone(cv->cv_wchan, &cv->wc_spin);
         spinlock_release(&cv->wc_spin);
@@ -348,7 +510,7 @@ void
 cv_broadcast(struct cv *cv, struct lock *lock)
 {
 #ifdef OPT_CONDVARS
-        KASSERT(lock->lk_owner == curthread);
+        KASSERT(lock_do_i_hold(lock));
         spinlock_acquire(&cv->wc_spin);
         wchan_wakeall(cv->cv_wchan, &cv->wc_spin);
         spinlock_release(&cv->wc_spin);
@@ -358,3 +520,149 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	(void)lock;  // suppress warning until code gets written
 #endif
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+        struct rwlock *rw;
+
+        rw = kmalloc(sizeof(*rw));
+        if (rw == NULL) {
+                return NULL;
+        }
+
+        rw->rwlock_name = kstrdup(name);
+        if (rw->rwlock_name == NULL) {
+                kfree(rw);
+                return NULL;
+        }
+
+        rw->rw_readwchan = wchan_create(rw->rwlock_name);
+        if (rw->rw_readwchan == NULL) {
+                kfree(rw->rwlock_name);
+                kfree(rw);
+                return NULL;
+        }
+
+        rw->rw_writewchan = wchan_create(rw->rwlock_name);
+        if (rw->rw_writewchan == NULL) {
+                wchan_destroy(rw->rw_readwchan);
+                kfree(rw->rwlock_name);
+                kfree(rw);
+                return NULL;
+        }
+
+        spinlock_init(&rw->rw_lock);
+        spinlock_setname(&rw->rw_lock, name);
+        rw->rw_readers = 0;
+        rw->rw_readwaiters = 0;
+        rw->rw_writewaiters = 0;
+        rw->rw_writer = NULL;
+
+        return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(rw->rw_readers == 0);
+        KASSERT(rw->rw_writer == NULL);
+
+        /* wchan_destroy will assert if anyone's waiting */
+        spinlock_cleanup(&rw->rw_lock);
+        wchan_destroy(rw->rw_writewchan);
+        wchan_destroy(rw->rw_readwchan);
+        kfree(rw->rwlock_name);
+        kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+        spinlock_acquire(&rw->rw_lock);
+        KASSERT(rw->rw_writer != curthread);
+        if (rw->rw_writer == NULL && rw->rw_writewaiters == 0) {
+                rw->rw_readers++;
+        }
+        else {
+                /*
+                 * Wait for the writer(s). rwlock_release_write
+                 * counts us into rw_readers before waking us, so a
+                 * writer arriving in between can't get in first.
+                 */
+                rw->rw_readwaiters++;
+                wchan_sleep(rw->rw_readwchan, &rw->rw_lock);
+                KASSERT(rw->rw_readers > 0);
+                KASSERT(rw->rw_writer == NULL);
+        }
+        spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_lock);
+        KASSERT(rw->rw_readers > 0);
+        KASSERT(rw->rw_writer == NULL);
+        rw->rw_readers--;
+        if (rw->rw_readers == 0 && rw->rw_writewaiters > 0) {
+                wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+        }
+        spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+        spinlock_acquire(&rw->rw_lock);
+        KASSERT(rw->rw_writer != curthread);
+        while (rw->rw_writer != NULL || rw->rw_readers > 0) {
+                rw->rw_writewaiters++;
+                wchan_sleep(rw->rw_writewchan, &rw->rw_lock);
+                KASSERT(rw->rw_writewaiters > 0);
+                rw->rw_writewaiters--;
+        }
+        rw->rw_writer = curthread;
+        spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_lock);
+        KASSERT(rw->rw_writer == curthread);
+        KASSERT(rw->rw_readers == 0);
+        rw->rw_writer = NULL;
+        if (rw->rw_readwaiters > 0) {
+                /* Let in every reader that queued up behind us. */
+                rw->rw_readers = rw->rw_readwaiters;
+                rw->rw_readwaiters = 0;
+                wchan_wakeall(rw->rw_readwchan, &rw->rw_lock);
+        }
+        else if (rw->rw_writewaiters > 0) {
+                wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+        }
+        spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        return rw->rw_writer == curthread;
+}
@@ -140,6 +140,11 @@ thread_create(const char *name)
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
+	thread->t_priority = 0;
+	thread->t_ticks = 0;
+	thread->t_readysince = 0;
+	thread->t_lastcpu = NULL;
+	thread->t_lastrun = 0;
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
@@ -179,13 +184,38 @@ cpu_create(unsigned hardware_number)
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
 
+	c->c_tlb_victim = 0;
+	c->c_tlb_misses = 0;
+	c->c_tlb_refills = 0;
+	c->c_tlb_evictions = 0;
+	c->c_tlb_flushes = 0;
+	c->c_tlb_preloads = 0;
+	c->c_asid_cache = 0;
+	c->c_asid = 0;
+	c->c_asid_rollovers = 0;
+	spinlock_init(&c->c_framecache_lock);
+	spinlock_setname(&c->c_framecache_lock, "framecache");
+	c->c_nframecache = 0;
+	c->c_fc_allocs = 0;
+	c->c_fc_frees = 0;
+	c->c_fc_refills = 0;
+	c->c_fc_drains = 0;
+	c->c_fc_reclaims = 0;
+	c->c_fc_nkernel = 0;
+	c->c_fc_nuser = 0;
+
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
+	spinlock_setname(&c->c_runqueue_lock, "runqueue");
+	c->c_steals = 0;
+	c->c_stolen = 0;
+	c->c_stealskips = 0;
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
 	spinlock_init(&c->c_ipi_lock);
+	spinlock_setname(&c->c_ipi_lock, "ipi");
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
 	if (result != 0) {
@@ -249,6 +279,18 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+struct cpu *
+cpu_get(unsigned n)
+{
+	return cpuarray_get(&allcpus, n);
+}
+
 /*
  * Destroy a thread.
  *
@@ -439,6 +481,165 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Put T on C's run queue, behind every thread of the same or higher
+ * priority and ahead of any of lower priority. The run queue is thus
+ * the multilevel feedback queue's levels laid end to end, and taking
+ * the head always gets the first thread of the highest nonempty
+ * level. C's run queue lock must be held.
+ */
+static
+void
+thread_enqueue(struct cpu *c, struct thread *t)
+{
+	struct threadlistnode *n;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	t->t_readysince = c->c_hardclocks;
+
+	/* Usually everything is at the same level, so search from the end. */
+	n = c->c_runqueue.tl_tail.tln_prev;
+	while (n->tln_self != NULL && n->tln_self->t_priority > t->t_priority) {
+		n = n->tln_prev;
+	}
+	if (n->tln_self == NULL) {
+		threadlist_addhead(&c->c_runqueue, t);
+	}
+	else {
+		threadlist_insertafter(&c->c_runqueue, n->tln_self, t);
+	}
+}
+
+/*
+ * Work stealing.
+ *
+ * A cpu that runs out of threads, rather than going idle, takes one
+ * from the cpu with the most threads waiting. Queue lengths are read
+ * without locking, so picking the victim costs no lock traffic; the
+ * victim's run queue lock is then the only one taken, and is never
+ * held together with our own, so there is no lock ordering to worry
+ * about.
+ *
+ * Moving a thread costs it its cache state (System/161 doesn't model
+ * caches, but real hardware does), so the victim's queue is searched
+ * for the thread that has been away from the cpu it last ran on the
+ * longest, measured in that cpu's hardclocks; threads that have
+ * never run count as the coldest of all. If even that one was there
+ * less than thread_migrate_hysteresis hardclocks ago, nothing is
+ * taken: it will likely get to run where it is soon enough, and
+ * bouncing threads between cpus helps nobody.
+ *
+ * The victim's curthread can't be taken: it can be on its own run
+ * queue while still running, if it went to sleep and was woken up
+ * again before its cpu left the idle loop.
+ *
+ * Called from thread_switch with interrupts off and our run queue
+ * unlocked. Returns true if there is now a thread on our run queue.
+ */
+unsigned thread_migrate_hysteresis = 2;
+
+/*
+ * How many hardclocks T has been away from the cpu it last ran on.
+ */
+static
+unsigned
+thread_awaytime(struct thread *t)
+{
+	if (t->t_lastcpu == NULL) {
+		return (unsigned)-1;
+	}
+	return t->t_lastcpu->c_hardclocks - t->t_lastrun;
+}
+
+static
+bool
+thread_steal(void)
+{
+	struct cpu *self, *c, *victim;
+	struct threadlistnode *n;
+	struct thread *t;
+	unsigned i, numcpus, most, away, coldest;
+
+	self = curcpu->c_self;
+	numcpus = cpuarray_num(&allcpus);
+
+	victim = NULL;
+	most = 0;
+	for (i=1; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, (self->c_number + i) % numcpus);
+		if (c->c_runqueue.tl_count > most) {
+			victim = c;
+			most = c->c_runqueue.tl_count;
+		}
+	}
+	if (victim == NULL) {
+		return false;
+	}
+
+	spinlock_acquire(&victim->c_runqueue_lock);
+	t = NULL;
+	coldest = 0;
+	/* From the tail, so ties go to the lowest priority. */
+	for (n = victim->c_runqueue.tl_tail.tln_prev; n->tln_self != NULL;
+	     n = n->tln_prev) {
+		if (n->tln_self == victim->c_curthread) {
+			continue;
+		}
+		away = thread_awaytime(n->tln_self);
+		if (t == NULL || away > coldest) {
+			t = n->tln_self;
+			coldest = away;
+		}
+	}
+	if (t != NULL && coldest < thread_migrate_hysteresis) {
+		victim->c_stealskips++;
+		t = NULL;
+	}
+	if (t != NULL) {
+		KASSERT(t->t_state == S_READY);
+		threadlist_remove(&victim->c_runqueue, t);
+		t->t_cpu = self;
+		victim->c_stolen++;
+	}
+	spinlock_release(&victim->c_runqueue_lock);
+
+	if (t == NULL) {
+		return false;
+	}
+
+	DEBUG(DB_THREADS, "cpu%u: stole thread %s from cpu%u\n",
+	      self->c_number, t->t_name, victim->c_number);
+
+	spinlock_acquire(&self->c_runqueue_lock);
+	thread_enqueue(self, t);
+	self->c_steals++;
+	spinlock_release(&self->c_runqueue_lock);
+	return true;
+}
+
+void
+thread_migstats(void)
+{
+	unsigned i, numcpus, steals, stolen, skips;
+	struct cpu *c;
+
+	kprintf("Migration hysteresis: %u hardclocks\n",
+		thread_migrate_hysteresis);
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		spinlock_acquire(&c->c_runqueue_lock);
+		steals = c->c_steals;
+		stolen = c->c_stolen;
+		skips = c->c_stealskips;
+		spinlock_release(&c->c_runqueue_lock);
+		kprintf("cpu%u: %u stolen in, %u stolen away, "
+			"%u refused as too warm\n", c->c_number,
+			steals, stolen, skips);
+	}
+}
+
 /*
  * Make a thread runnable.
  *
@@ -463,7 +664,7 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	thread_enqueue(targetcpu, target);
 
 	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
 		/*
@@ -610,6 +811,16 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		 */
 		threadlist_addtail(&wc->wc_threads, cur);
 		spinlock_release(lk);
+
+		/*
+		 * Giving up the cpu to wait for something is what
+		 * interactive and I/O-bound threads do; move up a
+		 * level and start a fresh quantum.
+		 */
+		if (cur->t_priority > 0) {
+			cur->t_priority--;
+		}
+		cur->t_ticks = 0;
 		break;
 	    case S_ZOMBIE:
 		cur->t_wchan_name = "ZOMBIE";
@@ -618,11 +829,18 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	}
 	cur->t_state = newstate;
 
+	/* Remember where and when it last ran, for thread_steal. */
+	cur->t_lastcpu = curcpu->c_self;
+	cur->t_lastrun = curcpu->c_hardclocks;
+
 	/*
-	 * Get the next thread. While there isn't one, call cpu_idle().
-	 * curcpu->c_isidle must be true when cpu_idle is
-	 * called. Unlock the runqueue while idling too, to make sure
-	 * things can be added to it.
+	 * Get the next thread. While there isn't one, try to steal one
+	 * from another cpu (see thread_steal), and call cpu_idle() if
+	 * that fails too. curcpu->c_isidle must be true when cpu_idle
+	 * is called. Unlock the runqueue while stealing and idling, to
+	 * make sure things can be added to it. The timer interrupt
+	 * brings us out of cpu_idle every hardclock, so an idle cpu
+	 * looks for work to steal that often.
 	 *
 	 * Note that we don't need to unlock the runqueue atomically
 	 * with idling; becoming unidle requires receiving an
@@ -641,7 +859,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			if (!thread_steal()) {
+				cpu_idle();
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
@@ -813,139 +1033,99 @@ thread_yield(void)
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
- */
-
-void
-schedule(void)
-{
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
-}
-
-/*
- * Thread migration.
+ * Each cpu runs a multilevel feedback queue with SCHED_NLEVELS
+ * levels; level 0 is the highest priority. The run queue is kept
+ * sorted by level (see thread_enqueue), and threads at the same
+ * level run round-robin. A thread at level L gets a quantum of
+ * SCHED_QUANTUM(L) hardclocks, so the lower the level, the longer
+ * it runs once it gets the cpu.
  *
- * This is also called periodically from hardclock(). If the current
- * CPU is busy and other CPUs are idle, or less busy, it should move
- * threads across to those other other CPUs.
+ *    - New threads start at level 0.
+ *    - A thread that uses up its whole quantum is CPU-bound: it
+ *      drops a level (thread_timeslice).
+ *    - A thread that goes to sleep on a wait channel before then
+ *      is interactive or I/O-bound: it rises a level (thread_switch).
+ *    - A thread that has waited on the run queue for
+ *      SCHED_AGE_HARDCLOCKS rises a level, so CPU-bound threads
+ *      still get to run when interactive ones keep the upper levels
+ *      busy (schedule).
  *
- * Migrating threads isn't free because of cache affinity; a thread's
- * working cache set will end up having to be moved to the other CPU,
- * which is fairly slow. The tradeoff between this performance loss
- * and the performance loss due to underutilization of some CPUs is
- * something that needs to be tuned and probably is workload-specific.
- *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * A thread woken at a higher level than the one running goes ahead
+ * of it in the queue, and takes over the cpu at the next hardclock.
  */
+#define SCHED_NLEVELS		4
+#define SCHED_QUANTUM(level)	(1U << (level))
+#define SCHED_AGE_HARDCLOCKS	100
+
 void
-thread_consider_migration(void)
+thread_timeslice(void)
 {
-	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
-	struct cpu *c;
-	struct threadlist victims;
-	struct thread *t;
+	struct thread *cur, *next;
+	bool preempt;
 
-	my_count = total_count = 0;
-	numcpus = cpuarray_num(&allcpus);
-	for (i=0; i<numcpus; i++) {
-		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
-		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
-		}
-		spinlock_release(&c->c_runqueue_lock);
-	}
+	cur = curthread;
 
-	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	if (curcpu->c_isidle) {
+		/* Nobody is running. */
+		spinlock_release(&curcpu->c_runqueue_lock);
 		return;
 	}
 
-	to_send = my_count - one_share;
-	threadlist_init(&victims);
-	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+	cur->t_ticks++;
+	if (cur->t_ticks >= SCHED_QUANTUM(cur->t_priority)) {
+		if (cur->t_priority < SCHED_NLEVELS - 1) {
+			cur->t_priority++;
+		}
+		cur->t_ticks = 0;
+		preempt = true;
+	}
+	else {
+		next = curcpu->c_runqueue.tl_head.tln_next->tln_self;
+		preempt = next != NULL && next->t_priority < cur->t_priority;
 	}
 	spinlock_release(&curcpu->c_runqueue_lock);
 
-	for (i=0; i < numcpus && to_send > 0; i++) {
-		c = cpuarray_get(&allcpus, i);
-		if (c == curcpu->c_self) {
-			continue;
-		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
-
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
-			if (c->c_isidle) {
-				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
-				 */
-				ipi_send(c, IPI_UNIDLE);
-			}
-		}
-		spinlock_release(&c->c_runqueue_lock);
+	if (preempt) {
+		thread_yield();
 	}
+}
 
-	/*
-	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
-	 */
-	if (!threadlist_isempty(&victims)) {
-		spinlock_acquire(&curcpu->c_runqueue_lock);
-		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+/*
+ * This is called periodically from hardclock(). It ages the current
+ * CPU's run queue: threads that have been waiting too long move up a
+ * level.
+ */
+void
+schedule(void)
+{
+	struct threadlist aged;
+	struct threadlistnode *n;
+	struct thread *t;
+	unsigned now;
+
+	threadlist_init(&aged);
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	now = curcpu->c_hardclocks;
+	n = curcpu->c_runqueue.tl_head.tln_next;
+	while (n->tln_self != NULL) {
+		t = n->tln_self;
+		n = n->tln_next;
+		if (t->t_priority > 0 &&
+		    now - t->t_readysince >= SCHED_AGE_HARDCLOCKS) {
+			threadlist_remove(&curcpu->c_runqueue, t);
+			threadlist_addtail(&aged, t);
 		}
-		spinlock_release(&curcpu->c_runqueue_lock);
 	}
+	while ((t = threadlist_remhead(&aged)) != NULL) {
+		t->t_priority--;
+		t->t_ticks = 0;
+		thread_enqueue(curcpu->c_self, t);
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
 
-	KASSERT(threadlist_isempty(&victims));
-	threadlist_cleanup(&victims);
+	threadlist_cleanup(&aged);
 }
 
 ////////////////////////////////////////////////////////////
@@ -90,9 +90,14 @@ DEFARRAY(knowndev, static __UNUSED inline);
 
 static struct knowndevarray *knowndevs;
 
-/* The big lock for all FS ops. Remove for filesystem assignment. */
-static struct lock *vfs_biglock;
-static unsigned vfs_biglock_depth;
+/*
+ * Lock for knowndevs. Name lookups (every path starting with
+ * "device:") only read the table, so they share the lock; adding
+ * devices and mounting or unmounting take it exclusively. This is
+ * acquired before any filesystem's own locks, never while holding
+ * them.
+ */
+static struct rwlock *knowndevs_lock;
 
 
 /*
@@ -106,49 +111,15 @@ vfs_bootstrap(void)
 		panic("vfs: Could not create knowndevs array\n");
 	}
 
-	vfs_biglock = lock_create("vfs_biglock");
-	if (vfs_biglock==NULL) {
-		panic("vfs: Could not create vfs big lock\n");
+	knowndevs_lock = rwlock_create("knowndevs");
+	if (knowndevs_lock==NULL) {
+		panic("vfs: Could not create knowndevs lock\n");
 	}
-	vfs_biglock_depth = 0;
 
 	devnull_create();
 	semfs_bootstrap();
 }
 
-/*
- * Operations on vfs_biglock. We make it recursive to avoid having to
- * think about where we do and don't already hold it. This is an
- * undesirable hack that's frequently necessary when a lock covers too
- * much material. Your solution scheme for FS and VFS locking should
- * not require recursive locks.
- */
-void
-vfs_biglock_acquire(void)
-{
-	if (!lock_do_i_hold(vfs_biglock)) {
-		lock_acquire(vfs_biglock);
-	}
-	vfs_biglock_depth++;
-}
-
-void
-vfs_biglock_release(void)
-{
-	KASSERT(lock_do_i_hold(vfs_biglock));
-	KASSERT(vfs_biglock_depth > 0);
-	vfs_biglock_depth--;
-	if (vfs_biglock_depth == 0) {
-		lock_release(vfs_biglock);
-	}
-}
-
-bool
-vfs_biglock_do_i_hold(void)
-{
-	return lock_do_i_hold(vfs_biglock);
-}
-
 /*
  * Global sync function - call FSOP_SYNC on all devices.
  */
@@ -158,7 +129,7 @@ vfs_sync(void)
 	struct knowndev *dev;
 	unsigned i, num;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_read(knowndevs_lock);
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -168,7 +139,7 @@ vfs_sync(void)
 		}
 	}
 
-	vfs_biglock_release();
+	rwlock_release_read(knowndevs_lock);
 
 	return 0;
 }
@@ -177,14 +148,13 @@ vfs_sync(void)
  * Given a device name (lhd0, emu0, somevolname, null, etc.), hand
  * back an appropriate vnode.
  */
+static
 int
-vfs_getroot(const char *devname, struct vnode **ret)
+vfs_dogetroot(const char *devname, struct vnode **ret)
 {
 	struct knowndev *kd;
 	unsigned i, num;
 
-	KASSERT(vfs_biglock_do_i_hold());
-
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
 		kd = knowndevarray_get(knowndevs, i);
@@ -253,6 +223,17 @@ vfs_getroot(const char *devname, struct vnode **ret)
 	return ENODEV;
 }
 
+int
+vfs_getroot(const char *devname, struct vnode **ret)
+{
+	int result;
+
+	rwlock_acquire_read(knowndevs_lock);
+	result = vfs_dogetroot(devname, ret);
+	rwlock_release_read(knowndevs_lock);
+	return result;
+}
+
 /*
  * Given a filesystem, hand back the name of the device it's mounted on.
  */
@@ -260,12 +241,13 @@ const char *
 vfs_getdevname(struct fs *fs)
 {
 	struct knowndev *kd;
+	const char *name;
 	unsigned i, num;
 
 	KASSERT(fs != NULL);
 
-	KASSERT(vfs_biglock_do_i_hold());
-
+	name = NULL;
+	rwlock_acquire_read(knowndevs_lock);
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
 		kd = knowndevarray_get(knowndevs, i);
@@ -277,11 +259,13 @@ vfs_getdevname(struct fs *fs)
 			 * the fs cannot go away, and the device can't
 			 * go away until the fs goes away.
 			 */
-			return kd->kd_name;
+			name = kd->kd_name;
+			break;
 		}
 	}
+	rwlock_release_read(knowndevs_lock);
 
-	return NULL;
+	return name;
 }
 
 /*
@@ -341,7 +325,7 @@ badnames(const char *n1, const char *n2, const char *n3)
 	unsigned i, num;
 	struct knowndev *kd;
 
-	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(rwlock_do_i_hold_write(knowndevs_lock));
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -381,7 +365,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 	unsigned index;
 	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(knowndevs_lock);
 
 	name = kstrdup(dname);
 	if (name==NULL) {
@@ -433,7 +417,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 		dev->d_devnumber = index+1;
 	}
 
-	vfs_biglock_release();
+	rwlock_release_write(knowndevs_lock);
 	return 0;
 
  fail:
@@ -450,7 +434,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 		kfree(kd);
 	}
 
-	vfs_biglock_release();
+	rwlock_release_write(knowndevs_lock);
 	return result;
 }
 
@@ -479,7 +463,7 @@ vfs_addfs(const char *devname, struct fs *fs)
 
 /*
  * Look for a mountable device named DEVNAME.
- * Should already hold knowndevs_lock.
+ * Should already hold knowndevs_lock for writing.
  */
 static
 int
@@ -489,7 +473,7 @@ findmount(const char *devname, struct knowndev **result)
 	unsigned i, num;
 	bool found = false;
 
-	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(rwlock_do_i_hold_write(knowndevs_lock));
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; !found && i<num; i++) {
@@ -523,16 +507,16 @@ vfs_mount(const char *devname, void *data,
 	struct fs *fs;
 	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(knowndevs_lock);
 
 	result = findmount(devname, &kd);
 	if (result) {
-		vfs_biglock_release();
+		rwlock_release_write(knowndevs_lock);
 		return result;
 	}
 
 	if (kd->kd_fs != NULL) {
-		vfs_biglock_release();
+		rwlock_release_write(knowndevs_lock);
 		return EBUSY;
 	}
 	KASSERT(kd->kd_rawname != NULL);
@@ -540,7 +524,7 @@ vfs_mount(const char *devname, void *data,
 
 	result = mountfunc(data, kd->kd_device, &fs);
 	if (result) {
-		vfs_biglock_release();
+		rwlock_release_write(knowndevs_lock);
 		return result;
 	}
 
@@ -553,7 +537,7 @@ vfs_mount(const char *devname, void *data,
 	kprintf("vfs: Mounted %s: on %s\n",
 		volname ? volname : kd->kd_name, kd->kd_name);
 
-	vfs_biglock_release();
+	rwlock_release_write(knowndevs_lock);
 	return 0;
 }
 
@@ -581,7 +565,7 @@ vfs_swapon(const char *devname, struct vnode **ret)
 		devname = myname;
 	}
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(knowndevs_lock);
 
 	result = findmount(devname, &kd);
 	if (result) {
@@ -602,7 +586,7 @@ vfs_swapon(const char *devname, struct vnode **ret)
 	*ret = kd->kd_vnode;
 
  out:
-	vfs_biglock_release();
+	rwlock_release_write(knowndevs_lock);
 	if (myname != NULL) {
 		kfree(myname);
 	}
@@ -620,7 +604,7 @@ vfs_unmount(const char *devname)
 	struct knowndev *kd;
 	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(knowndevs_lock);
 
 	result = findmount(devname, &kd);
 	if (result) {
@@ -653,7 +637,7 @@ vfs_unmount(const char *devname)
 	KASSERT(result==0);
 
  fail:
-	vfs_biglock_release();
+	rwlock_release_write(knowndevs_lock);
 	return result;
 }
 
@@ -670,7 +654,7 @@ vfs_swapoff(const char *devname)
 	struct knowndev *kd;
 	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(knowndevs_lock);
 
 	result = findmount(devname, &kd);
 	if (result) {
@@ -690,7 +674,7 @@ vfs_swapoff(const char *devname)
 	KASSERT(result==0);
 
  fail:
-	vfs_biglock_release();
+	rwlock_release_write(knowndevs_lock);
 	return result;
 }
 
@@ -704,7 +688,7 @@ vfs_unmountall(void)
 	unsigned i, num;
 	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(knowndevs_lock);
 
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
@@ -760,7 +744,7 @@ vfs_unmountall(void)
 		dev->kd_fs = NULL;
 	}
 
-	vfs_biglock_release();
+	rwlock_release_write(knowndevs_lock);
 
 	return 0;
 }
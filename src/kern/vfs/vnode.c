@@ -50,6 +50,7 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	vn->vn_ops = ops;
 	vn->vn_refcount = 1;
 	spinlock_init(&vn->vn_countlock);
+	spinlock_setname(&vn->vn_countlock, "vnode");
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
 	return 0;
@@ -129,9 +130,6 @@ vnode_decref(struct vnode *vn)
 void
 vnode_check(struct vnode *v, const char *opstr)
 {
-	/* not safe, and not really needed to check constant fields */
-	/*vfs_biglock_acquire();*/
-
 	if (v == NULL) {
 		panic("vnode_check: vop_%s: null vnode\n", opstr);
 	}
@@ -174,5 +172,4 @@ vnode_check(struct vnode *v, const char *opstr)
 	}
 
 	spinlock_release(&v->vn_countlock);
-	/*vfs_biglock_release();*/
 }
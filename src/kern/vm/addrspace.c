@@ -29,15 +29,28 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/mman.h>
 #include <lib.h>
+#include <limits.h>
+#include <stat.h>
 #include <addrspace.h>
 #include <vm.h>
 #include <proc.h>
+#include <vnode.h>
+#include <pagetable.h>
+#include <shm.h>
 
 /*
- * Note! If OPT_DUMBVM is set, as is the case until you start the VM
- * assignment, this file is not compiled or linked or in any way
- * used. The cheesy hack versions in dumbvm.c are used instead.
+ * Address spaces for the paging VM system.
+ *
+ * An address space is a list of regions plus a page table. Nothing
+ * is allocated when a region is defined: vm_fault allocates each page
+ * the first time it is touched, and fills it from the region's
+ * backing file (see as_map_segment) or with zeros.
+ *
+ * Note! If OPT_DUMBVM is set, this file is not compiled or linked or
+ * in any way used. The cheesy hack versions in dumbvm.c are used
+ * instead.
  */
 
 struct addrspace *
@@ -50,28 +63,170 @@ as_create(void)
 		return NULL;
 	}
 
-	/*
-	 * Initialize as needed.
-	 */
+	as->as_regions = NULL;
+	as->as_heap = NULL;
+	as->as_brk = 0;
+	as->as_stack = NULL;
+	as->as_stacklimit = VM_STACKLIMIT;
+	as->as_stackmax = VM_STACKMAX;
+	as->as_asid = 0;
+	as->as_asidcpu = 0;
+	as->as_faults = 0;
+	as->as_preloads = 0;
+	as->as_pt = pt_create();
+	if (as->as_pt == NULL) {
+		kfree(as);
+		return NULL;
+	}
 
 	return as;
 }
 
+/*
+ * Append a region to the address space's list.
+ */
+static
+int
+as_add_region(struct addrspace *as, vaddr_t vaddr, size_t npages,
+	      int readable, int writeable, int executable,
+	      struct region **ret)
+{
+	struct region *rg, **tail;
+
+	rg = kmalloc(sizeof(struct region));
+	if (rg == NULL) {
+		return ENOMEM;
+	}
+	rg->rg_vbase = vaddr;
+	rg->rg_npages = npages;
+	rg->rg_readable = readable;
+	rg->rg_writeable = writeable;
+	rg->rg_executable = executable;
+	rg->rg_vnode = NULL;
+	rg->rg_fileoff = 0;
+	rg->rg_filevaddr = 0;
+	rg->rg_filesize = 0;
+	rg->rg_shm = NULL;
+	rg->rg_shmvbase = 0;
+	rg->rg_mapped = false;
+	rg->rg_shared = false;
+	rg->rg_next = NULL;
+
+	for (tail = &as->as_regions; *tail != NULL; tail = &(*tail)->rg_next) {
+		/* nothing */
+	}
+	*tail = rg;
+	if (ret != NULL) {
+		*ret = rg;
+	}
+	return 0;
+}
+
+/*
+ * Append a copy of region RG, including its backing file, to AS.
+ */
+static
+int
+as_dup_region(struct addrspace *as, struct region *rg, struct region **ret)
+{
+	struct region *newrg;
+	int result;
+
+	result = as_add_region(as, rg->rg_vbase, rg->rg_npages,
+			       rg->rg_readable, rg->rg_writeable,
+			       rg->rg_executable, &newrg);
+	if (result) {
+		return result;
+	}
+	if (rg->rg_vnode != NULL) {
+		VOP_INCREF(rg->rg_vnode);
+		newrg->rg_vnode = rg->rg_vnode;
+		newrg->rg_fileoff = rg->rg_fileoff;
+		newrg->rg_filevaddr = rg->rg_filevaddr;
+		newrg->rg_filesize = rg->rg_filesize;
+	}
+	if (rg->rg_shm != NULL) {
+		vm_lock_acquire();
+		shm_incref(rg->rg_shm);
+		vm_lock_release();
+		newrg->rg_shm = rg->rg_shm;
+		newrg->rg_shmvbase = rg->rg_shmvbase;
+	}
+	newrg->rg_mapped = rg->rg_mapped;
+	newrg->rg_shared = rg->rg_shared;
+	*ret = newrg;
+	return 0;
+}
+
+/*
+ * Unlink region RG from AS and free it.
+ */
+static
+void
+as_remove_region(struct addrspace *as, struct region *rg)
+{
+	struct region **prev;
+
+	for (prev = &as->as_regions; *prev != rg; prev = &(*prev)->rg_next) {
+		KASSERT(*prev != NULL);
+	}
+	*prev = rg->rg_next;
+	if (rg->rg_shm != NULL) {
+		/* First, so a file's object never outlives its vnode. */
+		vm_lock_acquire();
+		shm_decref(rg->rg_shm);
+		vm_lock_release();
+	}
+	if (rg->rg_vnode != NULL) {
+		VOP_DECREF(rg->rg_vnode);
+	}
+	kfree(rg);
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
 	struct addrspace *newas;
+	struct region *rg, *newrg;
+	int result;
 
 	newas = as_create();
 	if (newas==NULL) {
 		return ENOMEM;
 	}
 
+	for (rg = old->as_regions; rg != NULL; rg = rg->rg_next) {
+		result = as_dup_region(newas, rg, &newrg);
+		if (result) {
+			as_destroy(newas);
+			return result;
+		}
+		if (rg == old->as_heap) {
+			newas->as_heap = newrg;
+		}
+		if (rg == old->as_stack) {
+			newas->as_stack = newrg;
+		}
+	}
+	newas->as_brk = old->as_brk;
+	newas->as_stacklimit = old->as_stacklimit;
+	newas->as_stackmax = old->as_stackmax;
+
 	/*
-	 * Write this.
+	 * Share the parent's frames copy-on-write. Both sides now map
+	 * them read-only, so the writable translations the parent may
+	 * still have in the TLB must go: moving it to a fresh ASID
+	 * orphans them without flushing anybody else's.
 	 */
-
-	(void)old;
+	vm_lock_acquire();
+	result = pt_copy(old->as_pt, newas->as_pt);
+	old->as_asid = 0;
+	vm_tlbactivate(old);
+	vm_lock_release();
+	if (result) {
+		as_destroy(newas);
+		return result;
+	}
 
 	*ret = newas;
 	return 0;
@@ -80,10 +235,24 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 void
 as_destroy(struct addrspace *as)
 {
-	/*
-	 * Clean up as needed.
-	 */
+	int result;
+
+	vm_can_sleep();
+
+	result = as_sync(as, NULL);
+	if (result) {
+		kprintf("vm: writing back shared mappings: %s\n",
+			strerror(result));
+	}
 
+	while (as->as_regions != NULL) {
+		as_remove_region(as, as->as_regions);
+	}
+
+	/* This may wait for the pageout daemon to finish with a page. */
+	vm_lock_acquire();
+	pt_destroy(as->as_pt);
+	vm_lock_release();
 	kfree(as);
 }
 
@@ -102,17 +271,20 @@ as_activate(void)
 	}
 
 	/*
-	 * Write this.
+	 * TLB entries are tagged with the address space's ASID, so
+	 * nothing needs flushing: switching the ASID hides the
+	 * previous process's translations and brings back ours.
 	 */
+	vm_tlbactivate(as);
 }
 
 void
 as_deactivate(void)
 {
 	/*
-	 * Write this. For many designs it won't need to actually do
-	 * anything. See proc.c for an explanation of why it (might)
-	 * be needed.
+	 * Nothing to do: an address space's ASID is never handed out
+	 * again before the TLB is flushed at the next ASID rollover,
+	 * so its stale entries can't be matched.
 	 */
 }
 
@@ -122,34 +294,44 @@ as_deactivate(void)
  * VADDR+MEMSIZE.
  *
  * The READABLE, WRITEABLE, and EXECUTABLE flags are set if read,
- * write, or execute permission should be set on the segment. At the
- * moment, these are ignored. When you write the VM system, you may
- * want to implement them.
+ * write, or execute permission should be set on the segment. Writes
+ * to a region without WRITEABLE fault with EFAULT, and its pages are
+ * always loaded into the TLB without the dirty bit. The MIPS TLB has
+ * no way to refuse reads or instruction fetches, so READABLE and
+ * EXECUTABLE are only recorded.
  */
 int
 as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize,
 		 int readable, int writeable, int executable)
 {
-	/*
-	 * Write this.
-	 */
+	size_t npages;
 
-	(void)as;
-	(void)vaddr;
-	(void)memsize;
-	(void)readable;
-	(void)writeable;
-	(void)executable;
-	return ENOSYS;
+	vm_can_sleep();
+
+	/* Align the region. First, the base... */
+	memsize += vaddr & ~(vaddr_t)PAGE_FRAME;
+	vaddr &= PAGE_FRAME;
+
+	/* ...and now the length. */
+	memsize = (memsize + PAGE_SIZE - 1) & PAGE_FRAME;
+
+	npages = memsize / PAGE_SIZE;
+
+	if (vaddr + memsize > USERSPACETOP || vaddr + memsize < vaddr) {
+		return EFAULT;
+	}
+
+	return as_add_region(as, vaddr, npages,
+			     readable, writeable, executable, NULL);
 }
 
 int
 as_prepare_load(struct addrspace *as)
 {
 	/*
-	 * Write this.
+	 * Nothing to allocate up front: load_elf only records where
+	 * each segment comes from, and vm_fault reads the pages in.
 	 */
-
 	(void)as;
 	return 0;
 }
@@ -157,22 +339,30 @@ as_prepare_load(struct addrspace *as)
 int
 as_complete_load(struct addrspace *as)
 {
-	/*
-	 * Write this.
-	 */
+	struct region *rg;
+	vaddr_t top;
 
-	(void)as;
-	return 0;
+	/* The heap starts out empty, right after the last segment. */
+	top = 0;
+	for (rg = as->as_regions; rg != NULL; rg = rg->rg_next) {
+		if (rg->rg_vbase + rg->rg_npages * PAGE_SIZE > top) {
+			top = rg->rg_vbase + rg->rg_npages * PAGE_SIZE;
+		}
+	}
+	as->as_brk = top;
+	return as_add_region(as, top, 0, 1, 1, 0, &as->as_heap);
 }
 
 int
 as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 {
-	/*
-	 * Write this.
-	 */
+	int result;
 
-	(void)as;
+	result = as_add_region(as, USERSTACK - VM_STACKPAGES * PAGE_SIZE,
+			       VM_STACKPAGES, 1, 1, 0, &as->as_stack);
+	if (result) {
+		return result;
+	}
 
 	/* Initial user-level stack pointer */
 	*stackptr = USERSTACK;
@@ -180,3 +370,397 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+struct region *
+as_find_region(struct addrspace *as, vaddr_t vaddr)
+{
+	struct region *rg;
+
+	for (rg = as->as_regions; rg != NULL; rg = rg->rg_next) {
+		if (vaddr >= rg->rg_vbase &&
+		    vaddr < rg->rg_vbase + rg->rg_npages * PAGE_SIZE) {
+			return rg;
+		}
+	}
+	return NULL;
+}
+
+struct region *
+as_growstack(struct addrspace *as, vaddr_t vaddr)
+{
+	struct region *stack, *rg;
+	vaddr_t base;
+
+	stack = as->as_stack;
+	if (stack == NULL || vaddr >= stack->rg_vbase ||
+	    vaddr < USERSTACK - as->as_stacklimit) {
+		return NULL;
+	}
+	base = vaddr & PAGE_FRAME;
+
+	/* Keep a page free between the stack and anything below it. */
+	for (rg = as->as_regions; rg != NULL; rg = rg->rg_next) {
+		if (rg != stack && rg->rg_vbase < stack->rg_vbase &&
+		    rg->rg_vbase + (rg->rg_npages + 1) * PAGE_SIZE > base) {
+			return NULL;
+		}
+	}
+
+	stack->rg_npages += (stack->rg_vbase - base) / PAGE_SIZE;
+	stack->rg_vbase = base;
+	return stack;
+}
+
+int
+as_setstacklimit(struct addrspace *as, rlim_t cur, rlim_t max)
+{
+	size_t limit;
+
+	if (max > as->as_stackmax) {
+		return EPERM;
+	}
+	if (cur > max) {
+		return EINVAL;
+	}
+
+	/* Both fit in a size_t now. The stack grows a page at a time. */
+	limit = (size_t)cur & PAGE_FRAME;
+	if (limit <= ARG_MAX) {
+		return EINVAL;
+	}
+
+	as->as_stacklimit = limit;
+	as->as_stackmax = (size_t)max;
+	return 0;
+}
+
+int
+as_map_segment(struct addrspace *as, vaddr_t vaddr, size_t memsize,
+	       struct vnode *v, off_t offset, size_t filesize)
+{
+	struct region *rg;
+
+	KASSERT(filesize <= memsize);
+
+	rg = as_find_region(as, vaddr);
+	if (rg == NULL || rg->rg_vnode != NULL ||
+	    vaddr + memsize > rg->rg_vbase + rg->rg_npages * PAGE_SIZE) {
+		/* Not what as_define_region was told, or overlapping. */
+		return ENOEXEC;
+	}
+
+	VOP_INCREF(v);
+	rg->rg_vnode = v;
+	rg->rg_fileoff = offset;
+	rg->rg_filevaddr = vaddr;
+	rg->rg_filesize = filesize;
+	return 0;
+}
+
+/*
+ * The heap region always covers the break rounded up to a page, so
+ * any address below the break faults in like any other page, and the
+ * pages above it are gone as soon as the break drops below them.
+ */
+int
+as_sbrk(struct addrspace *as, intptr_t amount, vaddr_t *oldbrk)
+{
+	struct region *heap, *rg;
+	vaddr_t newbrk, oldtop, newtop;
+
+	heap = as->as_heap;
+	if (heap == NULL) {
+		/* Not loaded from an executable. */
+		return ENOMEM;
+	}
+
+	newbrk = as->as_brk + amount;
+	if (amount < 0 ? newbrk > as->as_brk : newbrk < as->as_brk) {
+		/* wrapped around */
+		return amount < 0 ? EINVAL : ENOMEM;
+	}
+	if (newbrk < heap->rg_vbase) {
+		return EINVAL;
+	}
+
+	oldtop = heap->rg_vbase + heap->rg_npages * PAGE_SIZE;
+	newtop = ROUNDUP(newbrk, PAGE_SIZE);
+	if (newtop < newbrk || newtop > USERSPACETOP) {
+		return ENOMEM;
+	}
+
+	if (newtop > oldtop) {
+		/*
+		 * Don't run into the stack or anything else, and leave
+		 * the stack its guard page.
+		 */
+		for (rg = as->as_regions; rg != NULL; rg = rg->rg_next) {
+			if (rg != heap && rg->rg_vbase >= oldtop &&
+			    rg->rg_vbase < newtop + PAGE_SIZE) {
+				return ENOMEM;
+			}
+		}
+	}
+
+	heap->rg_npages = (newtop - heap->rg_vbase) / PAGE_SIZE;
+	if (newtop < oldtop) {
+		vm_unmap(as, newtop, (oldtop - newtop) / PAGE_SIZE);
+	}
+	*oldbrk = as->as_brk;
+	as->as_brk = newbrk;
+	return 0;
+}
+
+/*
+ * Find NPAGES of unused address space for a new mapping. Mappings go
+ * top-down from just below the lowest point the stack may grow to,
+ * leaving the space above the heap for sbrk.
+ */
+static
+int
+as_findspace(struct addrspace *as, size_t npages, vaddr_t *ret)
+{
+	struct region *rg;
+	vaddr_t top, base;
+	bool moved;
+
+	/* Leave the stack its guard page. */
+	top = USERSTACK - as->as_stacklimit - PAGE_SIZE;
+	do {
+		if (top < (npages + 1) * PAGE_SIZE) {
+			/* Never map page 0. */
+			return ENOMEM;
+		}
+		base = top - npages * PAGE_SIZE;
+		moved = false;
+		for (rg = as->as_regions; rg != NULL; rg = rg->rg_next) {
+			if (rg->rg_vbase < top &&
+			    rg->rg_vbase + rg->rg_npages * PAGE_SIZE > base) {
+				top = rg->rg_vbase;
+				moved = true;
+			}
+		}
+	} while (moved);
+
+	*ret = base;
+	return 0;
+}
+
+/*
+ * Anonymous part of as_mmap: NPAGES of zero-filled memory, either
+ * private or, if SHARED, backed by a new shared memory object.
+ */
+static
+int
+as_mmap_anon(struct addrspace *as, size_t npages, int prot, bool shared,
+	     vaddr_t *ret)
+{
+	struct region *rg;
+	struct shm *shm;
+	vaddr_t vaddr;
+	int result;
+
+	shm = NULL;
+	if (shared) {
+		shm = shm_create(npages);
+		if (shm == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = as_findspace(as, npages, &vaddr);
+	if (result == 0) {
+		result = as_add_region(as, vaddr, npages, prot & PROT_READ,
+				       prot & PROT_WRITE, prot & PROT_EXEC,
+				       &rg);
+	}
+	if (result) {
+		if (shm != NULL) {
+			vm_lock_acquire();
+			shm_decref(shm);
+			vm_lock_release();
+		}
+		return result;
+	}
+
+	rg->rg_shm = shm;
+	rg->rg_shmvbase = vaddr;
+	rg->rg_mapped = true;
+
+	*ret = vaddr;
+	return 0;
+}
+
+int
+as_mmap(struct addrspace *as, size_t len, int prot, int flags,
+	struct vnode *v, off_t offset, vaddr_t *ret)
+{
+	struct stat st;
+	struct region *rg;
+	struct shm *shm;
+	vaddr_t vaddr;
+	size_t npages, filesize;
+	int result;
+
+	if ((flags & ~MAP_ANON) != MAP_SHARED &&
+	    (flags & ~MAP_ANON) != MAP_PRIVATE) {
+		return EINVAL;
+	}
+	if (len == 0) {
+		return EINVAL;
+	}
+	if (len > USERSPACETOP) {
+		return ENOMEM;
+	}
+	npages = DIVROUNDUP(len, PAGE_SIZE);
+
+	if (flags & MAP_ANON) {
+		KASSERT(v == NULL);
+		return as_mmap_anon(as, npages, prot,
+				    (flags & MAP_SHARED) != 0, ret);
+	}
+
+	if (offset < 0 || (offset % PAGE_SIZE) != 0) {
+		return EINVAL;
+	}
+
+	result = VOP_MMAP(v, offset, len, prot);
+	if (result) {
+		return result;
+	}
+
+	/* Whatever lies past the end of the file reads as zeros. */
+	result = VOP_STAT(v, &st);
+	if (result) {
+		return result;
+	}
+	filesize = 0;
+	if (st.st_size > offset) {
+		filesize = st.st_size - offset < (off_t)len ?
+			st.st_size - offset : len;
+	}
+
+	/*
+	 * Shared mappings of a file all map its pages from one shared
+	 * object, indexed by page of the file, so that they see each
+	 * other's writes.
+	 */
+	shm = NULL;
+	if (flags == MAP_SHARED) {
+		if (offset > (off_t)(USERSPACETOP - len)) {
+			/* Too far in for the object's page array. */
+			return ENOMEM;
+		}
+		vm_lock_acquire();
+		shm = shm_getfile(v, offset / PAGE_SIZE + npages);
+		vm_lock_release();
+		if (shm == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = as_findspace(as, npages, &vaddr);
+	if (result == 0) {
+		result = as_add_region(as, vaddr, npages, prot & PROT_READ,
+				       prot & PROT_WRITE, prot & PROT_EXEC,
+				       &rg);
+	}
+	if (result) {
+		if (shm != NULL) {
+			vm_lock_acquire();
+			shm_decref(shm);
+			vm_lock_release();
+		}
+		return result;
+	}
+
+	VOP_INCREF(v);
+	rg->rg_vnode = v;
+	rg->rg_fileoff = offset;
+	rg->rg_filevaddr = vaddr;
+	rg->rg_filesize = filesize;
+	rg->rg_shm = shm;
+	rg->rg_shmvbase = vaddr - (vaddr_t)offset;
+	rg->rg_mapped = true;
+	rg->rg_shared = (flags == MAP_SHARED);
+
+	*ret = vaddr;
+	return 0;
+}
+
+int
+as_munmap(struct addrspace *as, vaddr_t vaddr, size_t len)
+{
+	struct region *rg, *next, *upper;
+	vaddr_t end, rgend, start, stop;
+	int result, err;
+
+	if ((vaddr & ~(vaddr_t)PAGE_FRAME) != 0 || len == 0) {
+		return EINVAL;
+	}
+	end = vaddr + ROUNDUP(len, PAGE_SIZE);
+	if (end <= vaddr || end > USERSPACETOP) {
+		return EINVAL;
+	}
+
+	err = 0;
+	for (rg = as->as_regions; rg != NULL; rg = next) {
+		next = rg->rg_next;
+		rgend = rg->rg_vbase + rg->rg_npages * PAGE_SIZE;
+		if (!rg->rg_mapped || rgend <= vaddr || rg->rg_vbase >= end) {
+			continue;
+		}
+		start = vaddr > rg->rg_vbase ? vaddr : rg->rg_vbase;
+		stop = end < rgend ? end : rgend;
+
+		if (start > rg->rg_vbase && stop < rgend) {
+			/* Punching a hole: the part above becomes its own. */
+			result = as_dup_region(as, rg, &upper);
+			if (result) {
+				return result;
+			}
+			upper->rg_vbase = stop;
+			upper->rg_npages = (rgend - stop) / PAGE_SIZE;
+		}
+
+		if (rg->rg_shared) {
+			result = vm_writeback(as, rg, start,
+					      (stop - start) / PAGE_SIZE);
+			if (result && err == 0) {
+				/* Keep going; the mapping goes anyway. */
+				err = result;
+			}
+		}
+
+		if (start == rg->rg_vbase && stop == rgend) {
+			as_remove_region(as, rg);
+		}
+		else if (start == rg->rg_vbase) {
+			rg->rg_npages = (rgend - stop) / PAGE_SIZE;
+			rg->rg_vbase = stop;
+		}
+		else {
+			rg->rg_npages = (start - rg->rg_vbase) / PAGE_SIZE;
+		}
+		vm_unmap(as, start, (stop - start) / PAGE_SIZE);
+	}
+	return err;
+}
+
+int
+as_sync(struct addrspace *as, struct vnode *v)
+{
+	struct region *rg;
+	int result, err;
+
+	err = 0;
+	for (rg = as->as_regions; rg != NULL; rg = rg->rg_next) {
+		if (!rg->rg_shared || (v != NULL && rg->rg_vnode != v)) {
+			continue;
+		}
+		result = vm_writeback(as, rg, rg->rg_vbase, rg->rg_npages);
+		if (result && err == 0) {
+			err = result;
+		}
+	}
+	return err;
+}
@@ -0,0 +1,985 @@
+/*
+ * Coremap: physical frame allocator for the paging VM system.
+ *
+ * Free memory is managed as a binary buddy system. A free block of
+ * order k is 2^k frames long and starts on a frame number that is a
+ * multiple of 2^k; its buddy is the block of the same order whose
+ * start differs only in bit k. Each order has a free list, threaded
+ * through the coremap entries of the blocks' first frames.
+ *
+ * Allocating 2^k frames takes the smallest free block of order >= k
+ * and splits it, handing the upper halves back to the lower free
+ * lists: O(log n). Freeing a block merges it with its buddy for as
+ * long as the buddy is also free, so large contiguous runs reform as
+ * soon as their pieces are given back instead of staying fragmented
+ * forever. Requests that are not a power of two keep only the frames
+ * they asked for; the tail of the block goes straight back to the
+ * free lists.
+ *
+ * Single-frame allocations, which are the vast majority, pop the
+ * order-0 list when it's not empty and only split a larger block
+ * otherwise, so they stay O(1) amortized.
+ *
+ * Which frames are in use is also kept in a bitmap (lib/bitmap.c),
+ * one bit per frame; the buddy test uses it, and it's what code that
+ * has to walk all allocated frames should scan.
+ *
+ * A per-frame entry records what the frame is used for and, for the
+ * first frame of an allocation, how many frames it has, so that
+ * free_kpages can give back the whole run. User frames also carry a
+ * reference count: after a copy-on-write fork the same frame is
+ * mapped by several address spaces, and it is only freed when the
+ * last of them lets go of it.
+ *
+ * User frames mapped by exactly one address space record which one
+ * and at what address, so the pageout daemon can find the page table
+ * entry to evict. When a shared frame drops back to one reference we
+ * no longer know which mapping is left, so the owner is forgotten
+ * and the frame can't be evicted until its remaining owner writes to
+ * it and claims it again in vm_cowbreak. Victims are chosen with the
+ * clock algorithm. MIPS has no hardware reference bit, so a frame
+ * counts as referenced whenever a translation for it is loaded into
+ * the TLB.
+ *
+ * When the number of free frames drops below a low watermark the
+ * pageout daemon is woken; it evicts pages until the high watermark
+ * is reached again.
+ *
+ * Single frames go through small per-cpu caches in struct cpu (see
+ * coremap_cache_take below), so the common case never touches
+ * coremap_lock. The lock counts how often it is taken and how often
+ * somebody had to spin for it; memstats shows both.
+ *
+ * How many frames are in each state is kept as running counts so
+ * memstats never has to sweep the coremap: cm_nkernel and cm_nuser
+ * under coremap_lock for runs handed out by the buddy allocator, and
+ * c_fc_nkernel and c_fc_nuser in each cpu for single frames. A frame
+ * allocated on one cpu and freed on another leaves +1 on the first
+ * and -1 on the second, so only the sum over all cpus means anything.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <bitmap.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <wchan.h>
+#include <cpu.h>
+#include <current.h>
+#include <vm.h>
+#include <coremap.h>
+
+/* Frame states */
+#define CM_FREE         0       /* available */
+#define CM_FIXED        1       /* not managed; never freed */
+#define CM_KERNEL       2       /* kernel allocation (alloc_kpages) */
+#define CM_USER         3       /* backs a user page */
+#define CM_CACHED       4       /* free, in some cpu's frame cache */
+
+/* Largest buddy block: 2^10 frames (4M). */
+#define CM_MAXORDER     10
+#define CM_NORDERS      (CM_MAXORDER + 1)
+
+/* Free list terminator, and cme_order of frames that aren't block heads. */
+#define CM_NONE         0xffffffff
+#define CM_NOORDER      0xff
+
+struct coremap_entry {
+	unsigned char cme_state;        /* one of CM_* */
+	unsigned char cme_order;        /* order, if head of a free block */
+	unsigned char cme_referenced;   /* clock reference bit */
+	unsigned cme_npages;            /* run length, at the first frame */
+	unsigned cme_refcount;          /* page tables mapping a user frame */
+	unsigned cme_next;              /* free list links (frame numbers) */
+	unsigned cme_prev;
+	struct addrspace *cme_as;       /* sole mapping of a user frame... */
+	vaddr_t cme_vaddr;              /* ...and where; cme_as NULL if none */
+};
+
+static struct coremap_entry *coremap;
+static struct bitmap *cm_usedmap;       /* bit set = frame not free */
+static unsigned long cm_nframes;        /* frames in RAM */
+static unsigned long cm_firstframe;     /* first frame we manage */
+static unsigned cm_freelist[CM_NORDERS];        /* first free block */
+static unsigned long cm_nfreeblocks[CM_NORDERS];
+static unsigned long cm_nfree;          /* free frames, not counting caches */
+static unsigned long cm_nkernel;        /* multi-frame kernel allocations */
+static unsigned long cm_nuser;          /* ...and user ones (none so far) */
+static unsigned long cm_minfree;        /* ...fewest there have been */
+static unsigned long cm_lowat;          /* wake pageout below this... */
+static unsigned long cm_hiwat;          /* ...and let it rest above this */
+static unsigned long cm_clockhand;      /* next frame the clock looks at */
+static struct wchan *cm_lowwchan;       /* where the pageout daemon waits */
+static bool coremap_ready = false;
+
+/*
+ * Protects everything above once the coremap is up, and the coremap
+ * entries of all frames except those in CM_CACHED or being handed
+ * out of or into a frame cache.
+ */
+static struct spinlock coremap_lock = SPINLOCK_INITIALIZER;
+static unsigned long cm_lockacquires;   /* times coremap_lock was taken */
+static unsigned long cm_lockcontended;  /* ...and was already held */
+
+/*
+ * Wrap ram_stealmem in a spinlock, for allocations made before
+ * coremap_bootstrap.
+ */
+static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Take coremap_lock, counting contention.
+ */
+static
+void
+coremap_lock_acquire(void)
+{
+	bool contended;
+
+	contended = !spinlock_tryacquire(&coremap_lock);
+	if (contended) {
+		spinlock_acquire(&coremap_lock);
+	}
+	cm_lockacquires++;
+	if (contended) {
+		cm_lockcontended++;
+	}
+}
+
+/*
+ * Smallest order whose blocks hold NPAGES frames.
+ */
+static
+unsigned
+buddy_order(unsigned long npages)
+{
+	unsigned k;
+
+	for (k=0; (1UL << k) < npages; k++) {
+		/* nothing */
+	}
+	return k;
+}
+
+static
+void
+buddy_push(unsigned long frame, unsigned order)
+{
+	unsigned head;
+
+	head = cm_freelist[order];
+	coremap[frame].cme_order = order;
+	coremap[frame].cme_prev = CM_NONE;
+	coremap[frame].cme_next = head;
+	if (head != CM_NONE) {
+		coremap[head].cme_prev = frame;
+	}
+	cm_freelist[order] = frame;
+	cm_nfreeblocks[order]++;
+}
+
+static
+void
+buddy_remove(unsigned long frame)
+{
+	struct coremap_entry *e = &coremap[frame];
+	unsigned order = e->cme_order;
+
+	KASSERT(order <= CM_MAXORDER);
+	if (e->cme_prev != CM_NONE) {
+		coremap[e->cme_prev].cme_next = e->cme_next;
+	}
+	else {
+		KASSERT(cm_freelist[order] == frame);
+		cm_freelist[order] = e->cme_next;
+	}
+	if (e->cme_next != CM_NONE) {
+		coremap[e->cme_next].cme_prev = e->cme_prev;
+	}
+	e->cme_order = CM_NOORDER;
+	e->cme_next = e->cme_prev = CM_NONE;
+	KASSERT(cm_nfreeblocks[order] > 0);
+	cm_nfreeblocks[order]--;
+}
+
+/*
+ * Give the free block of 2^ORDER frames at FRAME back to the free
+ * lists, merging it with its buddy as far up as possible.
+ */
+static
+void
+buddy_free(unsigned long frame, unsigned order)
+{
+	unsigned long buddy;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+	KASSERT((frame & ((1UL << order) - 1)) == 0);
+
+	while (order < CM_MAXORDER) {
+		buddy = frame ^ (1UL << order);
+		if (buddy + (1UL << order) > cm_nframes ||
+		    bitmap_isset(cm_usedmap, buddy) ||
+		    coremap[buddy].cme_order != order) {
+			break;
+		}
+		buddy_remove(buddy);
+		frame = frame < buddy ? frame : buddy;
+		order++;
+	}
+	buddy_push(frame, order);
+}
+
+/*
+ * Give back NPAGES free frames starting at FRAME, cut into the
+ * largest naturally aligned blocks that fit.
+ */
+static
+void
+buddy_freerange(unsigned long frame, unsigned long npages)
+{
+	unsigned k;
+
+	while (npages > 0) {
+		k = 0;
+		while (k < CM_MAXORDER &&
+		       (frame & ((1UL << (k+1)) - 1)) == 0 &&
+		       (1UL << (k+1)) <= npages) {
+			k++;
+		}
+		buddy_free(frame, k);
+		frame += 1UL << k;
+		npages -= 1UL << k;
+	}
+}
+
+/*
+ * Take a free block of 2^ORDER frames off the free lists, splitting
+ * a larger one if needed. Returns the first frame, or -1.
+ */
+static
+long
+buddy_alloc(unsigned order)
+{
+	unsigned k;
+	unsigned long frame;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+
+	for (k=order; k<=CM_MAXORDER; k++) {
+		if (cm_freelist[k] != CM_NONE) {
+			break;
+		}
+	}
+	if (k > CM_MAXORDER) {
+		return -1;
+	}
+
+	frame = cm_freelist[k];
+	buddy_remove(frame);
+	while (k > order) {
+		k--;
+		buddy_push(frame + (1UL << k), k);
+	}
+	return frame;
+}
+
+void
+coremap_bootstrap(void)
+{
+	paddr_t cmpaddr, firstpaddr;
+	unsigned long cmpages, i;
+	unsigned k;
+
+	spinlock_setname(&coremap_lock, "coremap");
+	cm_nframes = ram_getsize() / PAGE_SIZE;
+
+	/*
+	 * The coremap and its bitmap have to come out of stolen
+	 * memory, so allocate them before taking over from ram.c.
+	 */
+	cmpages = DIVROUNDUP(cm_nframes * sizeof(struct coremap_entry),
+			     PAGE_SIZE);
+	cmpaddr = ram_stealmem(cmpages);
+	if (cmpaddr == 0) {
+		panic("coremap: cannot allocate %lu pages for the coremap\n",
+		      cmpages);
+	}
+	coremap = (struct coremap_entry *)PADDR_TO_KVADDR(cmpaddr);
+
+	cm_usedmap = bitmap_create(cm_nframes);
+	if (cm_usedmap == NULL) {
+		panic("coremap: cannot allocate frame bitmap\n");
+	}
+
+	/* From here on ram_stealmem no longer works. */
+	firstpaddr = ram_getfirstfree();
+	cm_firstframe = firstpaddr / PAGE_SIZE;
+
+	for (i=0; i<cm_nframes; i++) {
+		coremap[i].cme_state = i < cm_firstframe ? CM_FIXED : CM_FREE;
+		coremap[i].cme_order = CM_NOORDER;
+		coremap[i].cme_npages = 0;
+		coremap[i].cme_refcount = 0;
+		coremap[i].cme_next = coremap[i].cme_prev = CM_NONE;
+		coremap[i].cme_referenced = 0;
+		coremap[i].cme_as = NULL;
+		coremap[i].cme_vaddr = 0;
+		if (i < cm_firstframe) {
+			bitmap_mark(cm_usedmap, i);
+		}
+	}
+
+	coremap_lock_acquire();
+	for (k=0; k<CM_NORDERS; k++) {
+		cm_freelist[k] = CM_NONE;
+		cm_nfreeblocks[k] = 0;
+	}
+	buddy_freerange(cm_firstframe, cm_nframes - cm_firstframe);
+	cm_nfree = cm_nframes - cm_firstframe;
+	cm_minfree = cm_nfree;
+	cm_lowat = cm_nfree / 32 > 4 ? cm_nfree / 32 : 4;
+	cm_hiwat = 2 * cm_lowat;
+	cm_clockhand = cm_firstframe;
+	coremap_ready = true;
+	spinlock_release(&coremap_lock);
+
+	/* This allocates, so it has to wait until we're up. */
+	cm_lowwchan = wchan_create("coremap low");
+	if (cm_lowwchan == NULL) {
+		panic("coremap: cannot create wchan\n");
+	}
+
+	kprintf("coremap: %lu frames, %lu free\n", cm_nframes, cm_nfree);
+}
+
+/*
+ * Wake the pageout daemon if free memory is low. Called whenever
+ * cm_nfree goes down, so it also keeps the low-water mark.
+ */
+static
+void
+coremap_checklow(void)
+{
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+	if (cm_nfree < cm_minfree) {
+		cm_minfree = cm_nfree;
+	}
+	if (cm_nfree < cm_lowat && cm_lowwchan != NULL) {
+		wchan_wakeone(cm_lowwchan, &coremap_lock);
+	}
+}
+
+/*
+ * Per-cpu frame caches.
+ *
+ * Single frames are by far the most common allocation (every user
+ * page, every second-level page table, most kmalloc pages), and with
+ * several cpus faulting at once they would all queue up on
+ * coremap_lock for each one. Instead each cpu keeps up to
+ * CPU_FRAMECACHE free frames of its own. An empty cache takes
+ * CM_BATCH frames from the buddy lists in one go; a full one gives
+ * CM_BATCH back the same way.
+ *
+ * Each cache has its own spinlock, c_framecache_lock. Only its own
+ * cpu takes it in the normal course of things, so it's never
+ * contended and its cache line stays put. It's there for when memory
+ * runs out: an allocation that finds nothing in the buddy lists takes
+ * every cpu's cache lock in turn and returns all their frames with
+ * coremap_cache_reclaim before it gives up, so free frames sitting
+ * idle in another cpu's cache don't cause an ENOMEM or an eviction.
+ * The cache lock comes before coremap_lock.
+ *
+ * Cached frames are in state CM_CACHED. They stay marked in the
+ * bitmap, so the buddy allocator doesn't merge them, and aren't
+ * counted in cm_nfree. A frame that goes in or out of a cache belongs
+ * to whoever is moving it, so its entry can be written without the
+ * lock; the state is always written last on the way out (and first
+ * on the way in) so the clock never mistakes it for a user page.
+ */
+#define CM_BATCH        (CPU_FRAMECACHE / 2)
+
+/*
+ * Fill C's cache up to CM_BATCH frames. C is the current cpu, and
+ * its cache lock is held.
+ */
+static
+void
+coremap_cache_refill(struct cpu *c)
+{
+	long frame;
+
+	KASSERT(spinlock_do_i_hold(&c->c_framecache_lock));
+
+	coremap_lock_acquire();
+	while (c->c_nframecache < CM_BATCH) {
+		frame = buddy_alloc(0);
+		if (frame < 0) {
+			break;
+		}
+		KASSERT(coremap[frame].cme_state == CM_FREE);
+		coremap[frame].cme_state = CM_CACHED;
+		bitmap_mark(cm_usedmap, frame);
+		c->c_framecache[c->c_nframecache++] = (paddr_t)frame * PAGE_SIZE;
+		cm_nfree--;
+	}
+	c->c_fc_refills++;
+	coremap_checklow();
+	spinlock_release(&coremap_lock);
+}
+
+/*
+ * Give the COUNT oldest frames in C's cache back to the buddy lists,
+ * keeping the most recently freed (cache-warm) ones. C's cache lock
+ * is held.
+ */
+static
+void
+coremap_cache_drain(struct cpu *c, unsigned count)
+{
+	unsigned long frame;
+	unsigned i;
+
+	KASSERT(spinlock_do_i_hold(&c->c_framecache_lock));
+	KASSERT(c->c_nframecache >= count);
+
+	coremap_lock_acquire();
+	for (i=0; i<count; i++) {
+		frame = c->c_framecache[i] / PAGE_SIZE;
+		KASSERT(coremap[frame].cme_state == CM_CACHED);
+		coremap[frame].cme_state = CM_FREE;
+		bitmap_unmark(cm_usedmap, frame);
+		buddy_free(frame, 0);
+		cm_nfree++;
+	}
+	c->c_fc_drains++;
+	spinlock_release(&coremap_lock);
+
+	c->c_nframecache -= count;
+	for (i=0; i<c->c_nframecache; i++) {
+		c->c_framecache[i] = c->c_framecache[i + count];
+	}
+}
+
+/*
+ * Empty every cpu's frame cache back into the buddy lists. Called
+ * when an allocation can't be satisfied, without any cache lock or
+ * coremap_lock held. Returns true if any frames came back.
+ */
+static
+bool
+coremap_cache_reclaim(void)
+{
+	struct cpu *c;
+	unsigned k, n;
+	bool got = false;
+
+	n = cpu_count();
+	for (k=0; k<n; k++) {
+		c = cpu_get(k);
+		spinlock_acquire(&c->c_framecache_lock);
+		if (c->c_nframecache > 0) {
+			coremap_cache_drain(c, c->c_nframecache);
+			c->c_fc_reclaims++;
+			got = true;
+		}
+		spinlock_release(&c->c_framecache_lock);
+	}
+	return got;
+}
+
+/*
+ * Allocate one frame in STATE from this cpu's cache.
+ */
+static
+paddr_t
+coremap_cache_take(unsigned char state)
+{
+	struct coremap_entry *e;
+	struct cpu *c;
+	paddr_t paddr;
+	bool reclaimed = false;
+	int spl;
+
+	while (1) {
+		/* Stay on this cpu until we have its cache lock. */
+		spl = splhigh();
+		c = curcpu->c_self;
+		spinlock_acquire(&c->c_framecache_lock);
+		if (c->c_nframecache == 0) {
+			coremap_cache_refill(c);
+		}
+		if (c->c_nframecache > 0) {
+			break;
+		}
+		spinlock_release(&c->c_framecache_lock);
+		splx(spl);
+
+		/* Nothing free; try the other cpus' caches, once. */
+		if (reclaimed || !coremap_cache_reclaim()) {
+			return 0;
+		}
+		reclaimed = true;
+	}
+	paddr = c->c_framecache[--c->c_nframecache];
+	c->c_fc_allocs++;
+	if (state == CM_KERNEL) {
+		c->c_fc_nkernel++;
+	}
+	else {
+		c->c_fc_nuser++;
+	}
+	spinlock_release(&c->c_framecache_lock);
+	splx(spl);
+
+	e = &coremap[paddr / PAGE_SIZE];
+	KASSERT(e->cme_state == CM_CACHED);
+	e->cme_npages = 1;
+	e->cme_refcount = 1;
+	e->cme_referenced = 0;
+	e->cme_as = NULL;
+	membar_store_store();
+	e->cme_state = state;
+	return paddr;
+}
+
+/*
+ * Put the single frame FRAME, just freed, in this cpu's cache.
+ */
+static
+void
+coremap_cache_give(unsigned long frame)
+{
+	struct coremap_entry *e;
+	struct cpu *c;
+	unsigned char state;
+	int spl;
+
+	e = &coremap[frame];
+	state = e->cme_state;
+	e->cme_state = CM_CACHED;
+	membar_store_store();
+	e->cme_npages = 0;
+	e->cme_refcount = 0;
+	e->cme_as = NULL;
+
+	spl = splhigh();
+	c = curcpu->c_self;
+	spinlock_acquire(&c->c_framecache_lock);
+	if (c->c_nframecache == CPU_FRAMECACHE) {
+		coremap_cache_drain(c, CM_BATCH);
+	}
+	c->c_framecache[c->c_nframecache++] = (paddr_t)frame * PAGE_SIZE;
+	c->c_fc_frees++;
+	if (state == CM_KERNEL) {
+		c->c_fc_nkernel--;
+	}
+	else {
+		c->c_fc_nuser--;
+	}
+	spinlock_release(&c->c_framecache_lock);
+	splx(spl);
+}
+
+/*
+ * Allocate NPAGES contiguous frames in STATE.
+ */
+static
+paddr_t
+coremap_take(unsigned long npages, unsigned char state)
+{
+	unsigned order;
+	unsigned long i;
+	long frame;
+	bool reclaimed = false;
+
+	KASSERT(npages > 0);
+	KASSERT(state == CM_KERNEL || state == CM_USER);
+
+	if (npages == 1) {
+		return coremap_cache_take(state);
+	}
+
+	order = buddy_order(npages);
+	if (order > CM_MAXORDER) {
+		return 0;
+	}
+
+	while (1) {
+		coremap_lock_acquire();
+		frame = buddy_alloc(order);
+		if (frame >= 0) {
+			break;
+		}
+		spinlock_release(&coremap_lock);
+
+		/*
+		 * Cached single frames can't merge with their buddies,
+		 * so give them all back and try once more.
+		 */
+		if (reclaimed || !coremap_cache_reclaim()) {
+			return 0;
+		}
+		reclaimed = true;
+	}
+
+	for (i=frame; i<frame+npages; i++) {
+		KASSERT(coremap[i].cme_state == CM_FREE);
+		coremap[i].cme_state = state;
+		coremap[i].cme_npages = 0;
+		bitmap_mark(cm_usedmap, i);
+	}
+	coremap[frame].cme_npages = npages;
+	coremap[frame].cme_refcount = 1;
+	coremap[frame].cme_referenced = 0;
+	coremap[frame].cme_as = NULL;
+
+	/* Return the unused tail of the block right away. */
+	buddy_freerange(frame + npages, (1UL << order) - npages);
+
+	cm_nfree -= npages;
+	if (state == CM_KERNEL) {
+		cm_nkernel += npages;
+	}
+	else {
+		cm_nuser += npages;
+	}
+	coremap_checklow();
+	spinlock_release(&coremap_lock);
+
+	return (paddr_t)frame * PAGE_SIZE;
+}
+
+paddr_t
+coremap_getppages(unsigned long npages)
+{
+	paddr_t addr;
+
+	KASSERT(npages > 0);
+
+	if (!coremap_ready) {
+		spinlock_acquire(&stealmem_lock);
+		addr = ram_stealmem(npages);
+		spinlock_release(&stealmem_lock);
+		return addr;
+	}
+	return coremap_take(npages, CM_KERNEL);
+}
+
+paddr_t
+coremap_alloc_upage(void)
+{
+	KASSERT(coremap_ready);
+	return coremap_take(1, CM_USER);
+}
+
+void
+coremap_freeppages(paddr_t paddr)
+{
+	unsigned long frame, npages, i;
+
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+
+	if (!coremap_ready) {
+		/* nothing - leak the memory. */
+		return;
+	}
+
+	frame = paddr / PAGE_SIZE;
+	KASSERT(frame < cm_nframes);
+
+	/*
+	 * The allocation is the caller's, so its entries can't change
+	 * under us; and fixed frames never change at all.
+	 */
+	if (coremap[frame].cme_state == CM_FIXED) {
+		/* Stolen before bootstrap; we can't take it back. */
+		return;
+	}
+	KASSERT(coremap[frame].cme_state == CM_KERNEL ||
+		coremap[frame].cme_state == CM_USER);
+	npages = coremap[frame].cme_npages;
+	KASSERT(npages > 0);
+	KASSERT(frame + npages <= cm_nframes);
+
+	if (npages == 1) {
+		coremap_cache_give(frame);
+		return;
+	}
+
+	coremap_lock_acquire();
+	if (coremap[frame].cme_state == CM_KERNEL) {
+		KASSERT(cm_nkernel >= npages);
+		cm_nkernel -= npages;
+	}
+	else {
+		KASSERT(cm_nuser >= npages);
+		cm_nuser -= npages;
+	}
+	for (i=frame; i<frame+npages; i++) {
+		coremap[i].cme_state = CM_FREE;
+		coremap[i].cme_npages = 0;
+		coremap[i].cme_refcount = 0;
+		coremap[i].cme_as = NULL;
+		bitmap_unmark(cm_usedmap, i);
+	}
+	buddy_freerange(frame, npages);
+	cm_nfree += npages;
+	spinlock_release(&coremap_lock);
+}
+
+/*
+ * Reference counting for user frames shared copy-on-write.
+ */
+static
+struct coremap_entry *
+coremap_userentry(paddr_t paddr)
+{
+	unsigned long frame;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+
+	frame = paddr / PAGE_SIZE;
+	KASSERT(frame < cm_nframes);
+	KASSERT(coremap[frame].cme_state == CM_USER);
+	KASSERT(coremap[frame].cme_refcount > 0);
+	return &coremap[frame];
+}
+
+void
+coremap_incref(paddr_t paddr)
+{
+	coremap_lock_acquire();
+	coremap_userentry(paddr)->cme_refcount++;
+	spinlock_release(&coremap_lock);
+}
+
+void
+coremap_decref(paddr_t paddr)
+{
+	struct coremap_entry *e;
+	unsigned refcount;
+
+	coremap_lock_acquire();
+	e = coremap_userentry(paddr);
+	refcount = --e->cme_refcount;
+	if (refcount == 1) {
+		/* We don't know which mapping is left. */
+		e->cme_as = NULL;
+	}
+	spinlock_release(&coremap_lock);
+
+	if (refcount == 0) {
+		coremap_freeppages(paddr);
+	}
+}
+
+unsigned
+coremap_refcount(paddr_t paddr)
+{
+	unsigned refcount;
+
+	coremap_lock_acquire();
+	refcount = coremap_userentry(paddr)->cme_refcount;
+	spinlock_release(&coremap_lock);
+	return refcount;
+}
+
+void
+coremap_setowner(paddr_t paddr, struct addrspace *as, vaddr_t vaddr)
+{
+	struct coremap_entry *e;
+
+	KASSERT((vaddr & PAGE_FRAME) == vaddr);
+
+	coremap_lock_acquire();
+	e = coremap_userentry(paddr);
+	KASSERT(e->cme_refcount == 1);
+	e->cme_as = as;
+	e->cme_vaddr = vaddr;
+	e->cme_referenced = 1;
+	spinlock_release(&coremap_lock);
+}
+
+void
+coremap_touch(paddr_t paddr)
+{
+	/*
+	 * No lock: this is called on every TLB refill, and a lost
+	 * update only costs the page its second chance.
+	 */
+	coremap[paddr / PAGE_SIZE].cme_referenced = 1;
+}
+
+paddr_t
+coremap_pickvictim(struct addrspace **as, vaddr_t *vaddr)
+{
+	struct coremap_entry *e;
+	unsigned long n, frame;
+
+	coremap_lock_acquire();
+
+	/*
+	 * Two turns of the clock: the first may do nothing but clear
+	 * reference bits.
+	 */
+	for (n=0; n<2*cm_nframes; n++) {
+		frame = cm_clockhand;
+		cm_clockhand++;
+		if (cm_clockhand == cm_nframes) {
+			cm_clockhand = cm_firstframe;
+		}
+
+		e = &coremap[frame];
+		if (e->cme_state != CM_USER || e->cme_refcount != 1 ||
+		    e->cme_as == NULL) {
+			continue;
+		}
+		if (e->cme_referenced) {
+			e->cme_referenced = 0;
+			continue;
+		}
+
+		*as = e->cme_as;
+		*vaddr = e->cme_vaddr;
+		/* Not a candidate again until it's mapped again. */
+		e->cme_as = NULL;
+		spinlock_release(&coremap_lock);
+		return (paddr_t)frame * PAGE_SIZE;
+	}
+
+	spinlock_release(&coremap_lock);
+	return 0;
+}
+
+void
+coremap_waitlow(void)
+{
+	coremap_lock_acquire();
+	while (cm_nfree >= cm_lowat) {
+		wchan_sleep(cm_lowwchan, &coremap_lock);
+	}
+	spinlock_release(&coremap_lock);
+}
+
+bool
+coremap_abovehigh(void)
+{
+	bool ret;
+
+	coremap_lock_acquire();
+	ret = cm_nfree >= cm_hiwat;
+	spinlock_release(&coremap_lock);
+	return ret;
+}
+
+void
+coremap_getstats(unsigned long *nframes, unsigned long *nfree,
+		 unsigned long *minfree)
+{
+	unsigned long ncached;
+	unsigned k, n;
+
+	/* Cache sizes are read unlocked; a rough count will do. */
+	ncached = 0;
+	n = cpu_count();
+	for (k=0; k<n; k++) {
+		ncached += cpu_get(k)->c_nframecache;
+	}
+
+	coremap_lock_acquire();
+	*nframes = cm_nframes - cm_firstframe;
+	*nfree = cm_nfree + ncached;
+	*minfree = cm_minfree;
+	spinlock_release(&coremap_lock);
+}
+
+void
+coremap_getlockstats(unsigned long *acquires, unsigned long *contended)
+{
+	coremap_lock_acquire();
+	*acquires = cm_lockacquires;
+	*contended = cm_lockcontended;
+	spinlock_release(&coremap_lock);
+}
+
+void
+coremap_printstats(void)
+{
+	unsigned long nfreeblocks[CM_NORDERS];
+	unsigned long ncached, nfree, nmanaged, inlarge;
+	unsigned long acquires, contended;
+	long nkernel, nuser;
+	unsigned k, largest, n;
+	struct cpu *c;
+
+	/*
+	 * The per-cpu counts are read unlocked, so with other cpus
+	 * allocating the totals can be off by a few frames.
+	 */
+	nkernel = nuser = ncached = 0;
+	n = cpu_count();
+	for (k=0; k<n; k++) {
+		c = cpu_get(k);
+		nkernel += c->c_fc_nkernel;
+		nuser += c->c_fc_nuser;
+		ncached += c->c_nframecache;
+	}
+
+	coremap_lock_acquire();
+	for (k=0; k<CM_NORDERS; k++) {
+		nfreeblocks[k] = cm_nfreeblocks[k];
+	}
+	nfree = cm_nfree;
+	nkernel += cm_nkernel;
+	nuser += cm_nuser;
+	acquires = cm_lockacquires;
+	contended = cm_lockcontended;
+	spinlock_release(&coremap_lock);
+
+	nmanaged = cm_nframes - cm_firstframe;
+
+	kprintf(" > Frames: %lu total, %lu fixed\n",
+		cm_nframes, cm_firstframe);
+	kprintf(" > Free: %lu (%lu%%), plus %lu in cpu caches\n",
+		nfree, 100 * nfree / nmanaged, ncached);
+	kprintf(" > Kernel: %ld, User: %ld\n", nkernel, nuser);
+	kprintf(" > Pageout watermarks: %lu low, %lu high\n",
+		cm_lowat, cm_hiwat);
+	kprintf(" > Coremap lock: %lu acquisitions, %lu contended\n",
+		acquires, contended);
+
+	for (k=0; k<n; k++) {
+		c = cpu_get(k);
+		kprintf(" > cpu%u frame cache: %u allocs, %u frees, "
+			"%u refills, %u drains, %u reclaimed\n", c->c_number,
+			c->c_fc_allocs, c->c_fc_frees, c->c_fc_refills,
+			c->c_fc_drains, c->c_fc_reclaims);
+	}
+
+	kprintf(" > Free buddy blocks:");
+	largest = 0;
+	inlarge = 0;
+	for (k=0; k<CM_NORDERS; k++) {
+		kprintf(" %dK:%lu", (PAGE_SIZE << k) / 1024, nfreeblocks[k]);
+		if (nfreeblocks[k] > 0) {
+			largest = k;
+		}
+		if (k >= 5) {
+			inlarge += nfreeblocks[k] << k;
+		}
+	}
+	kprintf("\n");
+
+	/*
+	 * Fragmentation: share of free memory that is not part of a
+	 * free block of 128K or more.
+	 */
+	if (nfree > 0) {
+		kprintf(" > Largest free block: %dK\n",
+			(PAGE_SIZE << largest) / 1024);
+		kprintf(" > Fragmentation: %lu%%\n",
+			100 - 100 * inlarge / nfree);
+	}
+}
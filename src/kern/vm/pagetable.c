@@ -0,0 +1,141 @@
+/*
+ * Two-level page table for user address spaces.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <vm.h>
+#include <coremap.h>
+#include <swap.h>
+#include <pagetable.h>
+
+struct pagetable *
+pt_create(void)
+{
+	struct pagetable *pt;
+
+	COMPILE_ASSERT(sizeof(struct pagetable) == PAGE_SIZE);
+
+	pt = kmalloc(sizeof(struct pagetable));
+	if (pt == NULL) {
+		return NULL;
+	}
+	bzero(pt, sizeof(struct pagetable));
+	return pt;
+}
+
+void
+pt_destroy(struct pagetable *pt)
+{
+	unsigned i, j;
+	pte_t *l2;
+
+	KASSERT(vm_lock_do_i_hold());
+
+	for (i=0; i<PT_NENTRIES; i++) {
+		l2 = pt->pt_dir[i];
+		if (l2 == NULL) {
+			continue;
+		}
+		for (j=0; j<PT_NENTRIES; j++) {
+			while (l2[j] & PTE_PAGEOUT) {
+				vm_pageout_wait();
+			}
+			if (l2[j] & PTE_VALID) {
+				coremap_decref(l2[j] & PTE_FRAME);
+			}
+			else if (l2[j] & PTE_SWAPPED) {
+				swap_decref(PTE_SLOT(l2[j]));
+			}
+		}
+		kfree(l2);
+	}
+	kfree(pt);
+}
+
+pte_t *
+pt_lookup(struct pagetable *pt, vaddr_t vaddr, bool create)
+{
+	pte_t *l2;
+
+	l2 = pt->pt_dir[PT_L1_INDEX(vaddr)];
+	if (l2 == NULL) {
+		if (!create) {
+			return NULL;
+		}
+		l2 = kmalloc(PT_NENTRIES * sizeof(pte_t));
+		if (l2 == NULL) {
+			return NULL;
+		}
+		bzero(l2, PT_NENTRIES * sizeof(pte_t));
+		pt->pt_dir[PT_L1_INDEX(vaddr)] = l2;
+	}
+	return &l2[PT_L2_INDEX(vaddr)];
+}
+
+int
+pt_copy(struct pagetable *oldpt, struct pagetable *newpt)
+{
+	unsigned i, j;
+	pte_t *oldl2, *newpte;
+	vaddr_t va;
+
+	KASSERT(vm_lock_do_i_hold());
+
+	for (i=0; i<PT_NENTRIES; i++) {
+		oldl2 = oldpt->pt_dir[i];
+		if (oldl2 == NULL) {
+			continue;
+		}
+		for (j=0; j<PT_NENTRIES; j++) {
+			while (oldl2[j] & PTE_PAGEOUT) {
+				vm_pageout_wait();
+			}
+			if ((oldl2[j] & (PTE_VALID | PTE_SWAPPED)) == 0) {
+				continue;
+			}
+			va = (i << PT_L1_SHIFT) | (j << PT_L2_SHIFT);
+			newpte = pt_lookup(newpt, va, true);
+			if (newpte == NULL) {
+				return ENOMEM;
+			}
+			if (oldl2[j] & PTE_SWAPPED) {
+				swap_incref(PTE_SLOT(oldl2[j]));
+			}
+			else {
+				if ((oldl2[j] & PTE_SHARED) == 0) {
+					oldl2[j] |= PTE_COW;
+				}
+				coremap_incref(oldl2[j] & PTE_FRAME);
+			}
+			*newpte = oldl2[j];
+		}
+	}
+	return 0;
+}
+
+void
+pt_count(struct pagetable *pt, unsigned *resident, unsigned *swapped)
+{
+	unsigned i, j;
+	pte_t *l2;
+
+	KASSERT(vm_lock_do_i_hold());
+
+	*resident = *swapped = 0;
+	for (i=0; i<PT_NENTRIES; i++) {
+		l2 = pt->pt_dir[i];
+		if (l2 == NULL) {
+			continue;
+		}
+		for (j=0; j<PT_NENTRIES; j++) {
+			if (l2[j] & (PTE_VALID | PTE_PAGEOUT)) {
+				(*resident)++;
+			}
+			else if (l2[j] & PTE_SWAPPED) {
+				(*swapped)++;
+			}
+		}
+	}
+}
@@ -0,0 +1,141 @@
+/*
+ * Shared memory objects; see shm.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <vm.h>
+#include <coremap.h>
+#include <shm.h>
+
+struct shm {
+	unsigned shm_refcount;
+	size_t shm_npages;
+	paddr_t *shm_pages;             /* frame of each page, or 0 */
+	struct vnode *shm_vn;           /* file it holds pages of, or NULL */
+	struct shm *shm_next;           /* next in shm_files */
+};
+
+/* The objects of files with MAP_SHARED mappings. */
+static struct shm *shm_files;
+
+struct shm *
+shm_create(size_t npages)
+{
+	struct shm *shm;
+
+	KASSERT(npages > 0);
+
+	shm = kmalloc(sizeof(*shm));
+	if (shm == NULL) {
+		return NULL;
+	}
+	shm->shm_pages = kmalloc(npages * sizeof(paddr_t));
+	if (shm->shm_pages == NULL) {
+		kfree(shm);
+		return NULL;
+	}
+	bzero(shm->shm_pages, npages * sizeof(paddr_t));
+	shm->shm_npages = npages;
+	shm->shm_refcount = 1;
+	shm->shm_vn = NULL;
+	shm->shm_next = NULL;
+	return shm;
+}
+
+struct shm *
+shm_getfile(struct vnode *vn, size_t npages)
+{
+	struct shm *shm;
+	paddr_t *pages;
+
+	KASSERT(vm_lock_do_i_hold());
+
+	for (shm = shm_files; shm != NULL; shm = shm->shm_next) {
+		if (shm->shm_vn == vn) {
+			break;
+		}
+	}
+
+	if (shm == NULL) {
+		shm = shm_create(npages);
+		if (shm == NULL) {
+			return NULL;
+		}
+		shm->shm_vn = vn;
+		shm->shm_next = shm_files;
+		shm_files = shm;
+		return shm;
+	}
+
+	if (npages > shm->shm_npages) {
+		pages = kmalloc(npages * sizeof(paddr_t));
+		if (pages == NULL) {
+			return NULL;
+		}
+		memcpy(pages, shm->shm_pages, shm->shm_npages * sizeof(paddr_t));
+		bzero(pages + shm->shm_npages,
+		      (npages - shm->shm_npages) * sizeof(paddr_t));
+		kfree(shm->shm_pages);
+		shm->shm_pages = pages;
+		shm->shm_npages = npages;
+	}
+	shm->shm_refcount++;
+	return shm;
+}
+
+void
+shm_incref(struct shm *shm)
+{
+	KASSERT(vm_lock_do_i_hold());
+	KASSERT(shm->shm_refcount > 0);
+
+	shm->shm_refcount++;
+}
+
+void
+shm_decref(struct shm *shm)
+{
+	struct shm **prev;
+	size_t i;
+
+	KASSERT(vm_lock_do_i_hold());
+	KASSERT(shm->shm_refcount > 0);
+
+	if (--shm->shm_refcount > 0) {
+		return;
+	}
+	if (shm->shm_vn != NULL) {
+		for (prev = &shm_files; *prev != shm;
+		     prev = &(*prev)->shm_next) {
+			KASSERT(*prev != NULL);
+		}
+		*prev = shm->shm_next;
+	}
+	for (i=0; i<shm->shm_npages; i++) {
+		if (shm->shm_pages[i] != 0) {
+			coremap_decref(shm->shm_pages[i]);
+		}
+	}
+	kfree(shm->shm_pages);
+	kfree(shm);
+}
+
+paddr_t
+shm_getpage(struct shm *shm, size_t index)
+{
+	KASSERT(vm_lock_do_i_hold());
+	KASSERT(index < shm->shm_npages);
+
+	return shm->shm_pages[index];
+}
+
+void
+shm_setpage(struct shm *shm, size_t index, paddr_t paddr)
+{
+	KASSERT(vm_lock_do_i_hold());
+	KASSERT(index < shm->shm_npages);
+	KASSERT(shm->shm_pages[index] == 0);
+
+	shm->shm_pages[index] = paddr;
+}
@@ -0,0 +1,227 @@
+/*
+ * Swap space for the paging VM system.
+ *
+ * Slots are allocated from a bitmap and carry a small reference count
+ * so that fork can share a swapped page the same way it shares a
+ * resident one. Paging I/O goes straight to the raw device vnode
+ * handed back by vfs_swapon, one page per transfer.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <bitmap.h>
+#include <spinlock.h>
+#include <uio.h>
+#include <stat.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <vm.h>
+#include <pagetable.h>
+#include <swap.h>
+
+static struct vnode *swap_vnode;        /* NULL if running without swap */
+static struct bitmap *swap_map;         /* bit set = slot in use */
+static uint16_t *swap_refcount;         /* per slot */
+static unsigned swap_nslots;
+static unsigned swap_nused;
+static unsigned swap_npageins;
+static unsigned swap_npageouts;
+
+/*
+ * Protects everything above. swap_vnode and the slot map are set once,
+ * by swap_on, and never change after that.
+ */
+static struct spinlock swap_lock = SPINLOCK_INITIALIZER;
+
+void
+swap_bootstrap(void)
+{
+	spinlock_setname(&swap_lock, "swap");
+}
+
+int
+swap_on(const char *devname)
+{
+	struct stat st;
+	struct vnode *vn;
+	struct bitmap *map;
+	uint16_t *refcount;
+	unsigned nslots;
+	int result;
+
+	result = vfs_swapon(devname, &vn);
+	if (result) {
+		return result;
+	}
+
+	result = VOP_STAT(vn, &st);
+	if (result) {
+		goto fail;
+	}
+
+	/* Page table entries have 20 bits for the slot number. */
+	nslots = st.st_size / PAGE_SIZE;
+	if (nslots > PTE_SLOTMAX) {
+		nslots = PTE_SLOTMAX;
+	}
+	if (nslots == 0) {
+		result = ENOSPC;
+		goto fail;
+	}
+
+	map = bitmap_create(nslots);
+	refcount = kmalloc(nslots * sizeof(refcount[0]));
+	if (map == NULL || refcount == NULL) {
+		if (map != NULL) {
+			bitmap_destroy(map);
+		}
+		if (refcount != NULL) {
+			kfree(refcount);
+		}
+		result = ENOMEM;
+		goto fail;
+	}
+	bzero(refcount, nslots * sizeof(refcount[0]));
+
+	spinlock_acquire(&swap_lock);
+	if (swap_vnode != NULL) {
+		spinlock_release(&swap_lock);
+		bitmap_destroy(map);
+		kfree(refcount);
+		result = EBUSY;
+		goto fail;
+	}
+	swap_map = map;
+	swap_refcount = refcount;
+	swap_nslots = nslots;
+	swap_vnode = vn;
+	spinlock_release(&swap_lock);
+
+	kprintf("swap: %u pages on %s\n", nslots, devname);
+	return 0;
+
+ fail:
+	vfs_swapoff(devname);
+	VOP_DECREF(vn);
+	return result;
+}
+
+int
+swap_alloc(unsigned *slot)
+{
+	spinlock_acquire(&swap_lock);
+	if (swap_vnode == NULL || bitmap_alloc(swap_map, slot)) {
+		spinlock_release(&swap_lock);
+		return ENOSPC;
+	}
+	KASSERT(swap_refcount[*slot] == 0);
+	swap_refcount[*slot] = 1;
+	swap_nused++;
+	spinlock_release(&swap_lock);
+	return 0;
+}
+
+void
+swap_incref(unsigned slot)
+{
+	spinlock_acquire(&swap_lock);
+	KASSERT(slot < swap_nslots);
+	KASSERT(swap_refcount[slot] > 0);
+	KASSERT(swap_refcount[slot] < 0xffff);
+	swap_refcount[slot]++;
+	spinlock_release(&swap_lock);
+}
+
+void
+swap_decref(unsigned slot)
+{
+	spinlock_acquire(&swap_lock);
+	KASSERT(slot < swap_nslots);
+	KASSERT(swap_refcount[slot] > 0);
+	if (--swap_refcount[slot] == 0) {
+		bitmap_unmark(swap_map, slot);
+		swap_nused--;
+	}
+	spinlock_release(&swap_lock);
+}
+
+/*
+ * Move one page between the frame at PADDR and swap slot SLOT.
+ */
+static
+int
+swap_io(unsigned slot, paddr_t paddr, enum uio_rw rw)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	KASSERT(swap_vnode != NULL);
+	KASSERT(slot < swap_nslots);
+	KASSERT(!vm_lock_do_i_hold());
+
+	uio_kinit(&iov, &ku, (void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE,
+		  (off_t)slot * PAGE_SIZE, rw);
+	if (rw == UIO_READ) {
+		result = VOP_READ(swap_vnode, &ku);
+	}
+	else {
+		result = VOP_WRITE(swap_vnode, &ku);
+	}
+	if (result) {
+		return result;
+	}
+	if (ku.uio_resid != 0) {
+		return EIO;
+	}
+
+	spinlock_acquire(&swap_lock);
+	if (rw == UIO_READ) {
+		swap_npageins++;
+	}
+	else {
+		swap_npageouts++;
+	}
+	spinlock_release(&swap_lock);
+	return 0;
+}
+
+int
+swap_read(unsigned slot, paddr_t paddr)
+{
+	return swap_io(slot, paddr, UIO_READ);
+}
+
+int
+swap_write(unsigned slot, paddr_t paddr)
+{
+	return swap_io(slot, paddr, UIO_WRITE);
+}
+
+void
+swap_getstats(unsigned *nslots, unsigned *nused,
+	      unsigned *npageins, unsigned *npageouts)
+{
+	spinlock_acquire(&swap_lock);
+	*nslots = swap_vnode != NULL ? swap_nslots : 0;
+	*nused = swap_nused;
+	*npageins = swap_npageins;
+	*npageouts = swap_npageouts;
+	spinlock_release(&swap_lock);
+}
+
+void
+swap_printstats(void)
+{
+	unsigned nslots, nused, npageins, npageouts;
+
+	swap_getstats(&nslots, &nused, &npageins, &npageouts);
+	if (nslots == 0) {
+		kprintf(" > Swap: none\n");
+		return;
+	}
+
+	kprintf(" > Swap: %u of %u slots used, %u pageins, %u pageouts\n",
+		nused, nslots, npageins, npageouts);
+}
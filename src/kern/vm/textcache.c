@@ -0,0 +1,195 @@
+/*
+ * Shared text pages for the paging VM system; see textcache.h.
+ *
+ * A small hash table of entries chained off fixed buckets. Everything
+ * here runs under the VM lock, so there is no lock of its own.
+ *
+ * tc_gen counts invalidations. A fault reads its page with the VM lock
+ * dropped, so it notes the generation first and textcache_insert turns
+ * the page away if the file was written in between.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <vnode.h>
+#include <vm.h>
+#include <coremap.h>
+#include <textcache.h>
+
+#define TC_NBUCKETS     64
+
+struct tc_entry {
+	struct vnode *tc_vn;
+	vaddr_t tc_vaddr;
+	paddr_t tc_paddr;
+	struct tc_entry *tc_next;
+};
+
+static struct tc_entry *tc_buckets[TC_NBUCKETS];
+static struct tc_entry *tc_dead;        /* reclaimed; vnode not yet let go */
+static unsigned tc_count;       /* entries in the table */
+static unsigned tc_hits;        /* faults that found their page here */
+static unsigned tc_inserts;     /* pages read from disk and added */
+static unsigned tc_reclaimed;   /* entries dropped to free memory */
+static unsigned tc_invalidated; /* entries dropped because the file changed */
+static unsigned tc_gen;         /* bumped by each textcache_invalidate */
+
+static
+unsigned
+tc_hash(struct vnode *vn, vaddr_t vaddr)
+{
+	return ((uintptr_t)vn / sizeof(*vn) + vaddr / PAGE_SIZE) % TC_NBUCKETS;
+}
+
+paddr_t
+textcache_lookup(struct vnode *vn, vaddr_t vaddr)
+{
+	struct tc_entry *tc;
+
+	KASSERT(vm_lock_do_i_hold());
+
+	for (tc = tc_buckets[tc_hash(vn, vaddr)]; tc != NULL; tc = tc->tc_next) {
+		if (tc->tc_vn == vn && tc->tc_vaddr == vaddr) {
+			coremap_incref(tc->tc_paddr);
+			tc_hits++;
+			return tc->tc_paddr;
+		}
+	}
+	return 0;
+}
+
+unsigned
+textcache_generation(void)
+{
+	KASSERT(vm_lock_do_i_hold());
+	return tc_gen;
+}
+
+int
+textcache_insert(struct vnode *vn, vaddr_t vaddr, paddr_t paddr, unsigned gen)
+{
+	struct tc_entry *tc;
+	unsigned h;
+
+	KASSERT(vm_lock_do_i_hold());
+	KASSERT((vaddr & PAGE_FRAME) == vaddr);
+
+	if (gen != tc_gen) {
+		/* Some file was written since the page was read. */
+		return EAGAIN;
+	}
+
+	tc = kmalloc(sizeof(*tc));
+	if (tc == NULL) {
+		return ENOMEM;
+	}
+	tc->tc_vn = vn;
+	tc->tc_vaddr = vaddr;
+	tc->tc_paddr = paddr;
+
+	VOP_INCREF(vn);
+	coremap_incref(paddr);
+
+	h = tc_hash(vn, vaddr);
+	tc->tc_next = tc_buckets[h];
+	tc_buckets[h] = tc;
+	tc_count++;
+	tc_inserts++;
+	return 0;
+}
+
+unsigned
+textcache_reclaim(void)
+{
+	struct tc_entry *tc, **prev;
+	unsigned i, freed;
+
+	KASSERT(vm_lock_do_i_hold());
+
+	freed = 0;
+	for (i=0; i<TC_NBUCKETS; i++) {
+		prev = &tc_buckets[i];
+		while ((tc = *prev) != NULL) {
+			if (coremap_refcount(tc->tc_paddr) > 1) {
+				prev = &tc->tc_next;
+				continue;
+			}
+			/*
+			 * The frame can go now, but the vnode reference
+			 * may be the last one, and reclaiming the vnode
+			 * does disk I/O; textcache_reap drops it later.
+			 */
+			*prev = tc->tc_next;
+			coremap_decref(tc->tc_paddr);
+			tc->tc_next = tc_dead;
+			tc_dead = tc;
+			freed++;
+		}
+	}
+	tc_count -= freed;
+	tc_reclaimed += freed;
+	return freed;
+}
+
+void
+textcache_reap(void)
+{
+	struct tc_entry *tc, *dead;
+
+	vm_lock_acquire();
+	dead = tc_dead;
+	tc_dead = NULL;
+	vm_lock_release();
+
+	while ((tc = dead) != NULL) {
+		dead = tc->tc_next;
+		VOP_DECREF(tc->tc_vn);
+		kfree(tc);
+	}
+}
+
+void
+textcache_invalidate(struct vnode *vn)
+{
+	struct tc_entry *tc, **prev, *dead;
+	unsigned i;
+
+	vm_lock_acquire();
+	tc_gen++;
+	dead = NULL;
+	for (i=0; i<TC_NBUCKETS; i++) {
+		prev = &tc_buckets[i];
+		while ((tc = *prev) != NULL) {
+			if (tc->tc_vn != vn) {
+				prev = &tc->tc_next;
+				continue;
+			}
+			/* Processes mapping the frame keep their references. */
+			*prev = tc->tc_next;
+			coremap_decref(tc->tc_paddr);
+			tc->tc_next = dead;
+			dead = tc;
+			tc_count--;
+			tc_invalidated++;
+		}
+	}
+	vm_lock_release();
+
+	/* The caller's own reference keeps VN alive through these. */
+	while ((tc = dead) != NULL) {
+		dead = tc->tc_next;
+		VOP_DECREF(tc->tc_vn);
+		kfree(tc);
+	}
+}
+
+void
+textcache_printstats(void)
+{
+	KASSERT(vm_lock_do_i_hold());
+
+	kprintf(" > Text cache: %u pages, %u hits, %u reads, "
+		"%u reclaimed, %u invalidated\n", tc_count, tc_hits,
+		tc_inserts, tc_reclaimed, tc_invalidated);
+}
@@ -0,0 +1,917 @@
+/*
+ * Demand-paged VM system.
+ *
+ * Physical memory is handed out by the coremap (coremap.c). User
+ * address spaces (addrspace.c) are a list of regions plus a two-level
+ * page table (pagetable.c); no frame is allocated for a user page
+ * until vm_fault sees the first access to it, at which point one
+ * frame is entered in the page table and the TLB. Program text and
+ * data are read in from the executable a page at a time as they are
+ * touched (load_elf only records where each segment lives in the
+ * file); read-only pages go in the text cache (textcache.c), so every
+ * process running the same program shares one copy, mapped
+ * copy-on-write. Files mapped with mmap are paged in the same way;
+ * pages of shared mappings are marked PTE_DIRTY when written, and
+ * vm_writeback copies those back to the file. Shared mappings, file
+ * or anonymous, map the frames of a shared object (shm.c) directly,
+ * marked PTE_SHARED so fork shares them too. Everything else starts
+ * out zero-filled. Zeroed frames normally come ready-made from the
+ * zero pool (zeropool.c), which a background thread fills while
+ * memory is plentiful, so the fault doesn't have to clear the page
+ * itself.
+ *
+ * as_copy shares frames between parent and child copy-on-write:
+ * both page tables map the frame with PTE_COW and the TLB entry is
+ * loaded without the dirty (write-enable) bit, so the first write
+ * from either side traps as VM_FAULT_READONLY and gets its own copy
+ * of just that page. Pages of regions that aren't writeable (program
+ * text and read-only data) are marked PTE_RDONLY and likewise never
+ * loaded with the dirty bit, but writing to them is a protection
+ * fault.
+ *
+ * When memory runs short, pages are evicted to swap (swap.c). A
+ * pageout daemon thread sleeps until free memory drops below the
+ * coremap's low watermark and then evicts pages chosen by the clock
+ * until the high watermark is reached; a fault that still finds no
+ * free frame evicts one itself.
+ *
+ * Page tables and paging state are protected by a single VM lock.
+ * It's dropped around swap I/O, with the page marked PTE_PAGEOUT (on
+ * the way out) or unowned in the coremap (on the way in) so nobody
+ * else touches it meanwhile. TLB refills of resident pages don't take
+ * the lock: they look at the page table with interrupts off, and
+ * eviction unmaps a page before shooting down its TLB entry and
+ * waiting for that to finish, so a refill can never load a page that
+ * is being evicted.
+ *
+ * Every TLB miss also preloads the neighboring resident pages
+ * (vm_faultaround), since the next access is likely to be next door.
+ * The MIPS TLB maps 4K pages only, so this is the closest we can get
+ * to large pages: a block of pages costs one trap instead of several,
+ * whether or not the frames behind it happen to be contiguous.
+ *
+ * Faults, and what they had to do about them, are counted in vmstat
+ * (vmstat.c), which user programs can read with the vmstat system
+ * call.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spl.h>
+#include <clock.h>
+#include <cpu.h>
+#include <thread.h>
+#include <synch.h>
+#include <proc.h>
+#include <current.h>
+#include <uio.h>
+#include <vnode.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <coremap.h>
+#include <pagetable.h>
+#include <swap.h>
+#include <zeropool.h>
+#include <textcache.h>
+#include <shm.h>
+#include <vmstat.h>
+
+unsigned vm_faultaround = VM_FAULTAROUND;
+bool vm_faultreport = false;
+
+static struct lock *vm_lock;
+static struct cv *vm_pageout_cv;        /* a PTE_PAGEOUT entry was resolved */
+
+static void vm_pageout_thread(void *junk1, unsigned long junk2);
+
+void
+vm_bootstrap(void)
+{
+	int result;
+
+	coremap_bootstrap();
+
+	vm_lock = lock_create("vm");
+	vm_pageout_cv = cv_create("pageout");
+	if (vm_lock == NULL || vm_pageout_cv == NULL) {
+		panic("vm: cannot create VM lock\n");
+	}
+
+	vm_tlbbootstrap();
+	swap_bootstrap();
+	zeropool_bootstrap();
+
+	result = thread_fork("pageout", NULL, vm_pageout_thread, NULL, 0);
+	if (result) {
+		panic("vm: cannot start pageout daemon: %s\n",
+		      strerror(result));
+	}
+}
+
+void
+vm_lock_acquire(void)
+{
+	lock_acquire(vm_lock);
+}
+
+void
+vm_lock_release(void)
+{
+	lock_release(vm_lock);
+}
+
+bool
+vm_lock_do_i_hold(void)
+{
+	return lock_do_i_hold(vm_lock);
+}
+
+void
+vm_pageout_wait(void)
+{
+	cv_wait(vm_pageout_cv, vm_lock);
+}
+
+/*
+ * Check if we're in a context that can sleep. Page faults may need
+ * to allocate memory, so the operations that can trigger them must
+ * not be called with spinlocks held or from interrupt handlers.
+ */
+void
+vm_can_sleep(void)
+{
+	if (CURCPU_EXISTS()) {
+		/* must not hold spinlocks */
+		KASSERT(curcpu->c_spinlocks == 0);
+
+		/* must not be in an interrupt handler */
+		KASSERT(curthread->t_in_interrupt == 0);
+	}
+}
+
+/* Allocate/free some kernel-space virtual pages */
+vaddr_t
+alloc_kpages(unsigned npages)
+{
+	paddr_t pa;
+
+	vm_can_sleep();
+	pa = coremap_getppages(npages);
+	if (pa==0) {
+		return 0;
+	}
+	return PADDR_TO_KVADDR(pa);
+}
+
+void
+free_kpages(vaddr_t addr)
+{
+	KASSERT(addr >= MIPS_KSEG0);
+	coremap_freeppages(addr - MIPS_KSEG0);
+}
+
+/*
+ * Evict one page to swap. Called with the VM lock held, which is
+ * dropped while the page is written out.
+ */
+static
+int
+vm_evict(void)
+{
+	struct addrspace *as;
+	vaddr_t vaddr;
+	paddr_t paddr;
+	unsigned slot;
+	pte_t *pte, old;
+	int result;
+
+	KASSERT(vm_lock_do_i_hold());
+
+	result = swap_alloc(&slot);
+	if (result) {
+		return result;
+	}
+
+	paddr = coremap_pickvictim(&as, &vaddr);
+	if (paddr == 0) {
+		swap_decref(slot);
+		return ENOMEM;
+	}
+
+	pte = pt_lookup(as->as_pt, vaddr, false);
+	KASSERT(pte != NULL);
+	/* Only unshared, non-COW frames have an owner. */
+	old = *pte;
+	KASSERT((old & ~(PTE_RDONLY | PTE_DIRTY)) == (paddr | PTE_VALID));
+
+	/* Unmap it before saving it, so nobody can write to it meanwhile. */
+	*pte = paddr | PTE_PAGEOUT;
+	vm_tlbinvalidate(as, vaddr);
+
+	vm_lock_release();
+	result = swap_write(slot, paddr);
+	vm_lock_acquire();
+
+	if (result) {
+		kprintf("vm: pageout: %s\n", strerror(result));
+		*pte = old;
+		coremap_setowner(paddr, as, vaddr);
+		swap_decref(slot);
+	}
+	else {
+		*pte = (slot << PTE_SLOTSHIFT) | PTE_SWAPPED |
+			(old & PTE_DIRTY);
+		coremap_decref(paddr);
+	}
+	cv_broadcast(vm_pageout_cv, vm_lock);
+	return result;
+}
+
+/*
+ * Get a frame for a user page, evicting something if memory is full.
+ * Frames set aside in the zero pool and text pages nobody maps are
+ * used up before anything is evicted. Called with the VM lock held;
+ * it may be dropped and reacquired, so the caller has to check its
+ * page table entry again afterwards.
+ */
+static
+paddr_t
+vm_alloc_upage(void)
+{
+	paddr_t paddr;
+
+	while ((paddr = coremap_alloc_upage()) == 0) {
+		paddr = zeropool_get();
+		if (paddr != 0) {
+			break;
+		}
+		if (textcache_reclaim() > 0) {
+			continue;
+		}
+		if (vm_evict()) {
+			return 0;
+		}
+	}
+	return paddr;
+}
+
+/*
+ * Pageout daemon: keep free memory between the coremap's watermarks
+ * so that most faults and kernel allocations find a free frame.
+ */
+static
+void
+vm_pageout_thread(void *junk1, unsigned long junk2)
+{
+	int result;
+
+	(void)junk1;
+	(void)junk2;
+
+	while (1) {
+		coremap_waitlow();
+
+		result = 0;
+		vm_lock_acquire();
+		textcache_reclaim();
+		while (!coremap_abovehigh()) {
+			result = vm_evict();
+			if (result) {
+				break;
+			}
+		}
+		vm_lock_release();
+		textcache_reap();
+
+		if (result) {
+			/* Nothing we can evict right now; don't spin. */
+			clocksleep(1);
+		}
+	}
+}
+
+/*
+ * Give the page mapped by PTE a frame of its own, so it can be
+ * written. If nobody else maps the frame any more we can simply
+ * take it over; otherwise copy it and drop our reference. Returns
+ * EAGAIN if the entry changed while we were waiting for memory.
+ */
+static
+int
+vm_cowbreak(struct addrspace *as, pte_t *pte, vaddr_t vaddr)
+{
+	paddr_t oldpa, newpa;
+	pte_t old;
+
+	KASSERT(*pte & PTE_VALID);
+	KASSERT(*pte & PTE_COW);
+
+	old = *pte;
+	oldpa = old & PTE_FRAME;
+	if (coremap_refcount(oldpa) == 1) {
+		*pte &= ~PTE_COW;
+		coremap_setowner(oldpa, as, vaddr);
+		return 0;
+	}
+
+	newpa = vm_alloc_upage();
+	if (newpa == 0) {
+		return ENOMEM;
+	}
+	if (*pte != old) {
+		coremap_freeppages(newpa);
+		return EAGAIN;
+	}
+	memmove((void *)PADDR_TO_KVADDR(newpa),
+		(const void *)PADDR_TO_KVADDR(oldpa), PAGE_SIZE);
+	vmstat_count(VMS_COWCOPY);
+	*pte = newpa | (old & ~(PTE_FRAME | PTE_COW));
+	coremap_decref(oldpa);
+	coremap_setowner(newpa, as, vaddr);
+	return 0;
+}
+
+/*
+ * True if page VADDR of region RG has contents in the region's file.
+ */
+static
+bool
+vm_filepage(struct region *rg, vaddr_t vaddr)
+{
+	return rg->rg_vnode != NULL &&
+		vaddr < rg->rg_filevaddr + rg->rg_filesize &&
+		vaddr + PAGE_SIZE > rg->rg_filevaddr;
+}
+
+/*
+ * Transfer the part of page VADDR of region RG that lives in the file
+ * between the file and the page-sized buffer PAGE. When reading, the
+ * rest of the buffer must already be zero. Called without the VM
+ * lock.
+ */
+static
+int
+vm_fileio(struct region *rg, vaddr_t vaddr, void *page, enum uio_rw rw)
+{
+	struct iovec iov;
+	struct uio ku;
+	vaddr_t start, end;
+	int result;
+
+	start = vaddr;
+	if (start < rg->rg_filevaddr) {
+		start = rg->rg_filevaddr;
+	}
+	end = vaddr + PAGE_SIZE;
+	if (end > rg->rg_filevaddr + rg->rg_filesize) {
+		end = rg->rg_filevaddr + rg->rg_filesize;
+	}
+	KASSERT(start < end);
+
+	uio_kinit(&iov, &ku, (char *)page + (start - vaddr), end - start,
+		  rg->rg_fileoff + (start - rg->rg_filevaddr), rw);
+	if (rw == UIO_READ) {
+		result = VOP_READ(rg->rg_vnode, &ku);
+	}
+	else {
+		result = VOP_WRITE(rg->rg_vnode, &ku);
+	}
+	if (result) {
+		return result;
+	}
+	if (ku.uio_resid != 0) {
+		/* The file got shorter since it was mapped. */
+		return EIO;
+	}
+	return 0;
+}
+
+/*
+ * First touch of a page whose contents come from the region's file.
+ * Read-only pages are looked up in and added to the text cache and
+ * mapped copy-on-write; others get a private frame like any other
+ * page. Called with the VM lock held, which is dropped while reading.
+ * Returns EAGAIN if the entry changed meanwhile.
+ */
+static
+int
+vm_filefault(struct addrspace *as, struct region *rg, pte_t *pte,
+	     vaddr_t vaddr)
+{
+	paddr_t paddr, cached;
+	bool cacheable;
+	unsigned gen;
+	int result;
+
+	KASSERT(*pte == 0);
+
+	/*
+	 * Only program segments go in the text cache: its key is the
+	 * load address, which says nothing about what part of the file
+	 * an mmap region maps.
+	 */
+	cacheable = !rg->rg_writeable && !rg->rg_mapped;
+	if (cacheable) {
+		paddr = textcache_lookup(rg->rg_vnode, vaddr);
+		if (paddr != 0) {
+			*pte = paddr | PTE_VALID | PTE_COW;
+			return 0;
+		}
+	}
+
+	paddr = zeropool_get();
+	if (paddr == 0) {
+		paddr = vm_alloc_upage();
+		if (paddr == 0) {
+			return ENOMEM;
+		}
+		if (*pte != 0) {
+			coremap_freeppages(paddr);
+			return EAGAIN;
+		}
+		bzero((void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+	}
+
+	/* The new frame has no owner, so it stays put while we read. */
+	gen = textcache_generation();
+	vm_lock_release();
+	result = vm_fileio(rg, vaddr, (void *)PADDR_TO_KVADDR(paddr), UIO_READ);
+	vm_lock_acquire();
+	if (result) {
+		coremap_freeppages(paddr);
+		return result;
+	}
+	vmstat_count(VMS_FILEREAD);
+	if (*pte != 0) {
+		coremap_freeppages(paddr);
+		return EAGAIN;
+	}
+
+	if (cacheable) {
+		cached = textcache_lookup(rg->rg_vnode, vaddr);
+		if (cached != 0) {
+			/* Another process read it in meanwhile. */
+			coremap_freeppages(paddr);
+			*pte = cached | PTE_VALID | PTE_COW;
+			return 0;
+		}
+		if (textcache_insert(rg->rg_vnode, vaddr, paddr, gen) == 0) {
+			*pte = paddr | PTE_VALID | PTE_COW;
+			return 0;
+		}
+		/* No room to share it, or it may be stale; keep it private. */
+	}
+
+	*pte = paddr | PTE_VALID;
+	coremap_setowner(paddr, as, vaddr);
+	return 0;
+}
+
+/*
+ * First touch of a page of a shared memory object: map the object's
+ * frame for it. If nobody has touched the page yet, allocate one,
+ * reading it in if the region maps a file there and zeroing it
+ * otherwise. Called with the VM lock held, which is dropped while
+ * reading; returns EAGAIN if the entry changed meanwhile.
+ */
+static
+int
+vm_shmfault(struct region *rg, pte_t *pte, vaddr_t vaddr)
+{
+	paddr_t paddr;
+	size_t index;
+	int result;
+
+	KASSERT(*pte == 0);
+
+	index = (vaddr - rg->rg_shmvbase) / PAGE_SIZE;
+	paddr = shm_getpage(rg->rg_shm, index);
+	if (paddr == 0) {
+		paddr = zeropool_get();
+		if (paddr == 0) {
+			paddr = vm_alloc_upage();
+			if (paddr == 0) {
+				return ENOMEM;
+			}
+			bzero((void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+			if (*pte != 0 ||
+			    shm_getpage(rg->rg_shm, index) != 0) {
+				/* Another process got there first. */
+				coremap_freeppages(paddr);
+				return EAGAIN;
+			}
+		}
+
+		if (vm_filepage(rg, vaddr)) {
+			/* As in vm_filefault, the frame has no owner yet. */
+			vm_lock_release();
+			result = vm_fileio(rg, vaddr,
+					   (void *)PADDR_TO_KVADDR(paddr),
+					   UIO_READ);
+			vm_lock_acquire();
+			if (result) {
+				coremap_freeppages(paddr);
+				return result;
+			}
+			if (*pte != 0 ||
+			    shm_getpage(rg->rg_shm, index) != 0) {
+				coremap_freeppages(paddr);
+				return EAGAIN;
+			}
+			vmstat_count(VMS_FILEREAD);
+		}
+		else {
+			vmstat_count(VMS_ZEROFILL);
+		}
+
+		/* The object keeps the allocation's reference. */
+		shm_setpage(rg->rg_shm, index, paddr);
+	}
+
+	coremap_incref(paddr);
+	*pte = paddr | PTE_VALID | PTE_SHARED;
+	return 0;
+}
+
+/*
+ * Fault-around: after a miss on FAULTADDRESS, load the translations
+ * of the other resident pages in its block of vm_faultaround pages.
+ * Entries are loaded the way the fast path would load them, so
+ * copy-on-write, read-only and clean shared pages still trap on
+ * write. Interrupts are off throughout, for the same reason as in the
+ * fast path.
+ */
+static
+void
+vm_preload(struct addrspace *as, vaddr_t faultaddress)
+{
+	vaddr_t vaddr, end;
+	pte_t *pte, entry;
+	paddr_t paddr;
+	int spl;
+
+	if (vm_faultaround <= 1) {
+		return;
+	}
+
+	vaddr = faultaddress & ~(vaddr_t)(vm_faultaround * PAGE_SIZE - 1);
+	end = vaddr + vm_faultaround * PAGE_SIZE;
+
+	spl = splhigh();
+	for (; vaddr < end; vaddr += PAGE_SIZE) {
+		if (vaddr == faultaddress) {
+			continue;
+		}
+		pte = pt_lookup(as->as_pt, vaddr, false);
+		entry = pte != NULL ? *pte : 0;
+		if ((entry & PTE_VALID) == 0) {
+			continue;
+		}
+		paddr = entry & PTE_FRAME;
+		if (vm_tlbpreload(vaddr, paddr,
+				  (entry & (PTE_COW | PTE_RDONLY)) == 0)) {
+			coremap_touch(paddr);
+			as->as_preloads++;
+		}
+	}
+	splx(spl);
+}
+
+/*
+ * Slow path of vm_fault: the page isn't resident, or is being
+ * written for the first time since fork. RG is the region containing
+ * the page. Called with the VM lock held.
+ */
+static
+int
+vm_pagefault(struct addrspace *as, struct region *rg, int faulttype,
+	     vaddr_t faultaddress)
+{
+	pte_t *pte, old;
+	paddr_t paddr;
+	int result;
+
+	if (faulttype != VM_FAULT_READ && !rg->rg_writeable) {
+		/* Write to text or read-only data. */
+		return EFAULT;
+	}
+	if (!rg->rg_readable && !rg->rg_writeable && !rg->rg_executable) {
+		/* PROT_NONE mapping */
+		return EFAULT;
+	}
+
+ again:
+	pte = pt_lookup(as->as_pt, faultaddress, true);
+	if (pte == NULL) {
+		return ENOMEM;
+	}
+	old = *pte;
+
+	if (old & PTE_PAGEOUT) {
+		/* On its way out; let that finish and then bring it back. */
+		vm_pageout_wait();
+		goto again;
+	}
+	else if (old == 0 && rg->rg_shm != NULL) {
+		result = vm_shmfault(rg, pte, faultaddress);
+		if (result == EAGAIN) {
+			goto again;
+		}
+		if (result) {
+			return result;
+		}
+	}
+	else if (old == 0 && vm_filepage(rg, faultaddress)) {
+		result = vm_filefault(as, rg, pte, faultaddress);
+		if (result == EAGAIN) {
+			goto again;
+		}
+		if (result) {
+			return result;
+		}
+	}
+	else if (old == 0 && (paddr = zeropool_get()) != 0) {
+		/* First touch, and there's a zeroed frame ready. */
+		*pte = paddr | PTE_VALID;
+		coremap_setowner(paddr, as, faultaddress);
+		vmstat_count(VMS_ZEROFILL);
+	}
+	else if ((old & PTE_VALID) == 0) {
+		paddr = vm_alloc_upage();
+		if (paddr == 0) {
+			return ENOMEM;
+		}
+		if (*pte != old) {
+			coremap_freeppages(paddr);
+			goto again;
+		}
+
+		if (old & PTE_SWAPPED) {
+			/*
+			 * The new frame has no owner yet, so it can't
+			 * be evicted while we're reading into it.
+			 */
+			vm_lock_release();
+			result = swap_read(PTE_SLOT(old), paddr);
+			vm_lock_acquire();
+			if (result) {
+				coremap_freeppages(paddr);
+				return result;
+			}
+			KASSERT(*pte == old);
+			swap_decref(PTE_SLOT(old));
+		}
+		else {
+			/* First touch, and the zero pool was empty. */
+			bzero((void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+			vmstat_count(VMS_ZEROFILL);
+		}
+		*pte = paddr | PTE_VALID | (old & PTE_DIRTY);
+		coremap_setowner(paddr, as, faultaddress);
+	}
+	else if (faulttype != VM_FAULT_READ && (old & PTE_COW)) {
+		/* Write to a shared page: copy it now. */
+		result = vm_cowbreak(as, pte, faultaddress);
+		if (result == EAGAIN) {
+			goto again;
+		}
+		if (result) {
+			return result;
+		}
+	}
+	/*
+	 * Anything else is a plain TLB miss, or a write to a page whose
+	 * copy-on-write was resolved since the TLB entry was loaded;
+	 * either way, just load the current entry.
+	 */
+
+	/* Let the fast path see the region's protection. */
+	if (!rg->rg_writeable) {
+		*pte |= PTE_RDONLY;
+	}
+	else if (rg->rg_shared) {
+		/* Track writes to shared file pages for vm_writeback. */
+		if (faulttype != VM_FAULT_READ) {
+			*pte = (*pte & ~PTE_RDONLY) | PTE_DIRTY;
+		}
+		else if ((*pte & PTE_DIRTY) == 0) {
+			*pte |= PTE_RDONLY;
+		}
+	}
+
+	paddr = *pte & PTE_FRAME;
+
+	/* make sure it's page-aligned */
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+
+	coremap_touch(paddr);
+	vm_tlbload(faultaddress, paddr,
+		   (*pte & (PTE_COW | PTE_RDONLY)) == 0, false);
+	vm_preload(as, faultaddress);
+	return 0;
+}
+
+int
+vm_fault(int faulttype, vaddr_t faultaddress)
+{
+	struct addrspace *as;
+	struct region *rg;
+	pte_t *pte, entry;
+	paddr_t paddr;
+	int spl, result;
+
+	faultaddress &= PAGE_FRAME;
+
+	DEBUG(DB_VM, "vm: fault: 0x%x\n", faultaddress);
+
+	switch (faulttype) {
+	    case VM_FAULT_READONLY:
+	    case VM_FAULT_READ:
+	    case VM_FAULT_WRITE:
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	if (curproc == NULL) {
+		/*
+		 * No process. This is probably a kernel fault early
+		 * in boot. Return EFAULT so as to panic instead of
+		 * getting into an infinite faulting loop.
+		 */
+		return EFAULT;
+	}
+
+	as = proc_getas();
+	if (as == NULL) {
+		/*
+		 * No address space set up. This is probably also a
+		 * kernel fault early in boot.
+		 */
+		return EFAULT;
+	}
+	as->as_faults++;
+	vmstat_count(faulttype == VM_FAULT_READ ? VMS_READFAULT :
+		     faulttype == VM_FAULT_WRITE ? VMS_WRITEFAULT :
+		     VMS_ROFAULT);
+
+	/*
+	 * Fast path: a plain TLB miss on a page that is already
+	 * resident. Anything in the page table was checked against the
+	 * regions when it was faulted in, so just reload it. Interrupts
+	 * stay off from the lookup until the entry is in the TLB, so a
+	 * shootdown from vm_evict can't slip in between.
+	 */
+	if (faulttype != VM_FAULT_READONLY) {
+		spl = splhigh();
+		pte = pt_lookup(as->as_pt, faultaddress, false);
+		entry = pte != NULL ? *pte : 0;
+		if ((entry & PTE_VALID) && (faulttype == VM_FAULT_READ ||
+		    (entry & (PTE_COW | PTE_RDONLY)) == 0)) {
+			paddr = entry & PTE_FRAME;
+			coremap_touch(paddr);
+			vm_tlbload(faultaddress, paddr,
+				   (entry & (PTE_COW | PTE_RDONLY)) == 0, true);
+			vm_preload(as, faultaddress);
+			splx(spl);
+			vmstat_count(VMS_REFILL);
+			return 0;
+		}
+		splx(spl);
+	}
+
+	rg = as_find_region(as, faultaddress);
+	if (rg == NULL) {
+		rg = as_growstack(as, faultaddress);
+		if (rg == NULL) {
+			return EFAULT;
+		}
+	}
+
+	vm_lock_acquire();
+	result = vm_pagefault(as, rg, faulttype, faultaddress);
+	vm_lock_release();
+	return result;
+}
+
+void
+vm_unmap(struct addrspace *as, vaddr_t vaddr, size_t npages)
+{
+	pte_t *pte, old;
+	size_t i;
+
+	vm_lock_acquire();
+	for (i=0; i<npages; i++, vaddr += PAGE_SIZE) {
+		pte = pt_lookup(as->as_pt, vaddr, false);
+		if (pte == NULL) {
+			continue;
+		}
+		while (*pte & PTE_PAGEOUT) {
+			vm_pageout_wait();
+		}
+		old = *pte;
+		*pte = 0;
+		if (old & PTE_VALID) {
+			/* As in vm_evict: unmap, shoot down, then free. */
+			vm_tlbinvalidate(as, vaddr);
+			coremap_decref(old & PTE_FRAME);
+		}
+		else if (old & PTE_SWAPPED) {
+			swap_decref(PTE_SLOT(old));
+		}
+	}
+	vm_lock_release();
+}
+
+int
+vm_writeback(struct addrspace *as, struct region *rg,
+	     vaddr_t vaddr, size_t npages)
+{
+	vaddr_t buf;
+	pte_t *pte, old;
+	size_t i;
+	int result;
+
+	KASSERT(rg->rg_shared);
+
+	/* Pages are copied out here, so they can't vanish while we write. */
+	buf = alloc_kpages(1);
+	if (buf == 0) {
+		return ENOMEM;
+	}
+
+	result = 0;
+	vm_lock_acquire();
+	for (i=0; i<npages && result == 0; i++, vaddr += PAGE_SIZE) {
+		if (!vm_filepage(rg, vaddr)) {
+			continue;
+		}
+		pte = pt_lookup(as->as_pt, vaddr, false);
+		if (pte == NULL) {
+			continue;
+		}
+		while (*pte & PTE_PAGEOUT) {
+			vm_pageout_wait();
+		}
+		old = *pte;
+		if ((old & PTE_DIRTY) == 0) {
+			continue;
+		}
+
+		/* Clean it first, so that any later write dirties it again. */
+		if (old & PTE_VALID) {
+			*pte = (old & ~PTE_DIRTY) | PTE_RDONLY;
+			vm_tlbinvalidate(as, vaddr);
+			memmove((void *)buf,
+				(const void *)PADDR_TO_KVADDR(old & PTE_FRAME),
+				PAGE_SIZE);
+			vm_lock_release();
+		}
+		else {
+			KASSERT(old & PTE_SWAPPED);
+			*pte = old & ~PTE_DIRTY;
+			vm_lock_release();
+			result = swap_read(PTE_SLOT(old), buf - MIPS_KSEG0);
+		}
+
+		if (result == 0) {
+			result = vm_fileio(rg, vaddr, (void *)buf, UIO_WRITE);
+		}
+
+		vm_lock_acquire();
+		if (result) {
+			while (*pte & PTE_PAGEOUT) {
+				vm_pageout_wait();
+			}
+			*pte |= PTE_DIRTY;
+		}
+	}
+	vm_lock_release();
+
+	free_kpages(buf);
+	return result;
+}
+
+void
+vm_faultstats(const char *name, struct addrspace *as)
+{
+	if (!vm_faultreport || as == NULL) {
+		return;
+	}
+	kprintf("%s: %u faults, %u translations preloaded\n",
+		name, as->as_faults, as->as_preloads);
+}
+
+void
+memstats(void)
+{
+	kprintf("* Virtual Memory Status *\n");
+	coremap_printstats();
+	swap_printstats();
+	zeropool_printstats();
+	vmstat_printstats();
+	vm_lock_acquire();
+	textcache_printstats();
+	vm_lock_release();
+}
@@ -0,0 +1,86 @@
+/*
+ * VM statistics.
+ *
+ * Events are counted in one array under a spinlock, since vm_fault
+ * counts from its fast path with interrupts off. Gauges (free memory,
+ * swap in use, a process's resident set) aren't kept here at all;
+ * vmstat_get asks whoever owns them.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <coremap.h>
+#include <pagetable.h>
+#include <swap.h>
+#include <vmstat.h>
+
+static unsigned vms_counts[VMS_NEVENTS];
+
+/* Protects vms_counts. */
+static struct spinlock vms_lock = SPINLOCK_INITIALIZER;
+
+void
+vmstat_count(unsigned event)
+{
+	KASSERT(event < VMS_NEVENTS);
+
+	spinlock_acquire(&vms_lock);
+	vms_counts[event]++;
+	spinlock_release(&vms_lock);
+}
+
+void
+vmstat_get(struct addrspace *as, struct vmstat *vs)
+{
+	unsigned long nframes, nfree, minfree;
+	unsigned npageins, npageouts;
+
+	bzero(vs, sizeof(*vs));
+	vs->vs_pagesize = PAGE_SIZE;
+
+	coremap_getstats(&nframes, &nfree, &minfree);
+	vs->vs_frames = nframes;
+	vs->vs_free = nfree;
+	vs->vs_minfree = minfree;
+
+	swap_getstats(&vs->vs_swapslots, &vs->vs_swapused,
+		      &npageins, &npageouts);
+	vs->vs_pageins = npageins;
+	vs->vs_pageouts = npageouts;
+
+	spinlock_acquire(&vms_lock);
+	vs->vs_readfaults = vms_counts[VMS_READFAULT];
+	vs->vs_writefaults = vms_counts[VMS_WRITEFAULT];
+	vs->vs_rofaults = vms_counts[VMS_ROFAULT];
+	vs->vs_refills = vms_counts[VMS_REFILL];
+	vs->vs_zerofills = vms_counts[VMS_ZEROFILL];
+	vs->vs_cowcopies = vms_counts[VMS_COWCOPY];
+	vs->vs_filereads = vms_counts[VMS_FILEREAD];
+	spinlock_release(&vms_lock);
+
+	if (as != NULL) {
+		vs->vs_myfaults = as->as_faults;
+		vm_lock_acquire();
+		pt_count(as->as_pt, &vs->vs_myresident, &vs->vs_myswapped);
+		vm_lock_release();
+	}
+}
+
+void
+vmstat_printstats(void)
+{
+	struct vmstat vs;
+
+	vmstat_get(NULL, &vs);
+	kprintf(" > Faults: %u read, %u write, %u read-only, "
+		"%u refilled from the page table\n", vs.vs_readfaults,
+		vs.vs_writefaults, vs.vs_rofaults, vs.vs_refills);
+	kprintf(" > Pages: %u zero-filled, %u copied on write, "
+		"%u read from files\n", vs.vs_zerofills, vs.vs_cowcopies,
+		vs.vs_filereads);
+	kprintf(" > Fewest free frames: %u of %u\n", vs.vs_minfree,
+		vs.vs_frames);
+}
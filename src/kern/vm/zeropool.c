@@ -0,0 +1,137 @@
+/*
+ * Pool of pre-zeroed page frames.
+ *
+ * The pool is a small stack of user frames that have already been
+ * cleared. A kernel thread keeps it topped up: it sleeps while the
+ * pool is more than half full, and otherwise clears one frame at a
+ * time, yielding after each so that anything else that is runnable
+ * goes first. It only takes frames while free memory is above the
+ * coremap's high watermark, so it never competes with the pageout
+ * daemon; when memory gets tight, vm_fault takes frames from the
+ * pool before it resorts to evicting pages.
+ *
+ * Frames in the pool are allocated user frames with no owner, so the
+ * clock never picks them.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <vm.h>
+#include <coremap.h>
+#include <zeropool.h>
+
+#define ZP_SIZE         16      /* frames in a full pool */
+
+static paddr_t zp_frames[ZP_SIZE];
+static unsigned zp_count;
+static unsigned zp_hits;        /* zero-fill faults served from the pool */
+static unsigned zp_misses;      /* ...that found it empty */
+static unsigned zp_filled;      /* frames cleared by the thread */
+static struct wchan *zp_wchan;  /* where the thread waits */
+
+/* Protects everything above. */
+static struct spinlock zp_lock = SPINLOCK_INITIALIZER;
+
+static
+void
+zeropool_thread(void *junk1, unsigned long junk2)
+{
+	paddr_t paddr;
+
+	(void)junk1;
+	(void)junk2;
+
+	while (1) {
+		spinlock_acquire(&zp_lock);
+		while (zp_count > ZP_SIZE / 2) {
+			wchan_sleep(zp_wchan, &zp_lock);
+		}
+		spinlock_release(&zp_lock);
+
+		/* Fill up, unless memory is short. */
+		while (zp_count < ZP_SIZE && coremap_abovehigh()) {
+			paddr = coremap_alloc_upage();
+			if (paddr == 0) {
+				break;
+			}
+			bzero((void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+
+			spinlock_acquire(&zp_lock);
+			/* We're the only one who adds frames. */
+			KASSERT(zp_count < ZP_SIZE);
+			zp_frames[zp_count++] = paddr;
+			zp_filled++;
+			spinlock_release(&zp_lock);
+
+			thread_yield();
+		}
+
+		spinlock_acquire(&zp_lock);
+		if (zp_count <= ZP_SIZE / 2) {
+			/* Couldn't get memory; try again later. */
+			spinlock_release(&zp_lock);
+			clocksleep(1);
+			continue;
+		}
+		spinlock_release(&zp_lock);
+	}
+}
+
+void
+zeropool_bootstrap(void)
+{
+	int result;
+
+	zp_wchan = wchan_create("zeropool");
+	if (zp_wchan == NULL) {
+		panic("zeropool: cannot create wchan\n");
+	}
+
+	result = thread_fork("pagezero", NULL, zeropool_thread, NULL, 0);
+	if (result) {
+		panic("zeropool: cannot start thread: %s\n",
+		      strerror(result));
+	}
+}
+
+paddr_t
+zeropool_get(void)
+{
+	paddr_t paddr;
+
+	spinlock_acquire(&zp_lock);
+	if (zp_count == 0) {
+		zp_misses++;
+		paddr = 0;
+	}
+	else {
+		zp_hits++;
+		paddr = zp_frames[--zp_count];
+	}
+	if (zp_count <= ZP_SIZE / 2) {
+		wchan_wakeone(zp_wchan, &zp_lock);
+	}
+	spinlock_release(&zp_lock);
+
+	return paddr;
+}
+
+void
+zeropool_printstats(void)
+{
+	unsigned count, hits, misses, filled;
+
+	spinlock_acquire(&zp_lock);
+	count = zp_count;
+	hits = zp_hits;
+	misses = zp_misses;
+	filled = zp_filled;
+	spinlock_release(&zp_lock);
+
+	kprintf(" > Zero pool: %u of %u frames ready, %u hits, %u misses, "
+		"%u cleared\n", count, ZP_SIZE, hits, misses, filled);
+}
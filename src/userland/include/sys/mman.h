@@ -0,0 +1,20 @@
+#ifndef _SYS_MMAN_H_
+#define _SYS_MMAN_H_
+
+/*
+ * Get the PROT_* and MAP_* flags from the kernel.
+ */
+#include <sys/types.h>
+#include <kern/mman.h>
+
+/*
+ * Memory mappings; see kern/mman.h. Changes made through a MAP_SHARED
+ * mapping of a file reach the file at munmap, at fsync on the file
+ * (prototyped in unistd.h), or when the process exits.
+ */
+void *mmap(void *addr, size_t len, int prot, int flags, int fd,
+	   off_t offset);
+int munmap(void *addr, size_t len);
+
+
+#endif /* _SYS_MMAN_H_ */
@@ -0,0 +1,19 @@
+#ifndef _SYS_RESOURCE_H_
+#define _SYS_RESOURCE_H_
+
+/*
+ * Get struct rlimit and the RLIMIT_* codes from the kernel.
+ */
+#include <sys/types.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+
+/*
+ * Resource limits. Only RLIMIT_STACK, the most the stack may grow
+ * to, is implemented; the others fail with EINVAL.
+ */
+int getrlimit(int resource, struct rlimit *rl);
+int setrlimit(int resource, const struct rlimit *rl);
+
+
+#endif /* _SYS_RESOURCE_H_ */
@@ -0,0 +1,16 @@
+#ifndef _SYS_VMSTAT_H_
+#define _SYS_VMSTAT_H_
+
+/*
+ * Get struct vmstat from the kernel.
+ */
+#include <sys/types.h>
+#include <kern/vmstat.h>
+
+/*
+ * Fill in BUF with the system's VM statistics; see kern/vmstat.h.
+ */
+int vmstat(struct vmstat *buf);
+
+
+#endif /* _SYS_VMSTAT_H_ */
@@ -0,0 +1,117 @@
+/*
+ * mmaptest - test MAP_SHARED file mappings.
+ *
+ * Maps the same file twice and checks that a write through one
+ * mapping is seen through the other at once, that fsync gets it into
+ * the file while it is still mapped, and that munmap writes back what
+ * was changed since.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define TESTFILE "mmaptest.dat"
+
+/* See sbrktest; there is no way to ask the kernel. */
+#define PAGE_SIZE 4096
+#define FILESIZE  (2 * PAGE_SIZE)
+
+static char buf[FILESIZE];
+
+/*
+ * Read the whole file through a fresh descriptor and check that byte
+ * POS is EXPECT.
+ */
+static
+void
+checkfile(size_t pos, char expect, const char *when)
+{
+	ssize_t r;
+	int fd;
+
+	fd = open(TESTFILE, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", TESTFILE);
+	}
+	r = read(fd, buf, FILESIZE);
+	if (r < 0) {
+		err(1, "%s: read", TESTFILE);
+	}
+	if (r != FILESIZE) {
+		errx(1, "%s: read: short count %d", TESTFILE, (int)r);
+	}
+	close(fd);
+
+	if (buf[pos] != expect) {
+		errx(1, "%s: byte %u is '%c' %s, expected '%c'", TESTFILE,
+		     (unsigned)pos, buf[pos], when, expect);
+	}
+}
+
+int
+main(void)
+{
+	char *p, *q;
+	ssize_t r;
+	int fd;
+
+	fd = open(TESTFILE, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: create", TESTFILE);
+	}
+	memset(buf, 'a', FILESIZE);
+	r = write(fd, buf, FILESIZE);
+	if (r < 0) {
+		err(1, "%s: write", TESTFILE);
+	}
+	if (r != FILESIZE) {
+		errx(1, "%s: write: short count %d", TESTFILE, (int)r);
+	}
+
+	p = mmap(NULL, FILESIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "mmap");
+	}
+	q = mmap(NULL, FILESIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (q == MAP_FAILED) {
+		err(1, "mmap (second mapping)");
+	}
+	if (p[100] != 'a' || q[PAGE_SIZE + 100] != 'a') {
+		errx(1, "Mappings don't show the file's contents");
+	}
+
+	printf("Writing through one mapping...\n");
+	p[0] = 'b';
+	if (q[0] != 'b') {
+		errx(1, "Write not seen through the other mapping");
+	}
+
+	printf("Checking fsync...\n");
+	if (fsync(fd) < 0) {
+		err(1, "fsync");
+	}
+	checkfile(0, 'b', "after fsync");
+
+	printf("Checking munmap...\n");
+	p[PAGE_SIZE + 1] = 'c';
+	if (munmap(p, FILESIZE) < 0) {
+		err(1, "munmap");
+	}
+	checkfile(PAGE_SIZE + 1, 'c', "after munmap");
+	if (q[PAGE_SIZE + 1] != 'c') {
+		errx(1, "Write lost from the other mapping after munmap");
+	}
+
+	if (munmap(q, FILESIZE) < 0) {
+		err(1, "munmap (second mapping)");
+	}
+	close(fd);
+
+	printf("Passed mmaptest.\n");
+	return 0;
+}
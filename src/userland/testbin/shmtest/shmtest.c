@@ -0,0 +1,78 @@
+/*
+ * shmtest - test MAP_SHARED|MAP_ANON memory across fork.
+ *
+ * The child writes to a shared anonymous mapping and to a private
+ * one and exits; the parent then checks that it sees the first write
+ * and not the second.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+
+/* See sbrktest; there is no way to ask the kernel. */
+#define PAGE_SIZE 4096
+
+#define MAGIC 0x5ca1ab1e
+
+int
+main(void)
+{
+	volatile int *shared, *private;
+	pid_t pid;
+	int status;
+
+	shared = mmap(NULL, PAGE_SIZE, PROT_READ|PROT_WRITE,
+		      MAP_SHARED|MAP_ANON, -1, 0);
+	if (shared == MAP_FAILED) {
+		err(1, "mmap (shared)");
+	}
+	private = mmap(NULL, PAGE_SIZE, PROT_READ|PROT_WRITE,
+		       MAP_PRIVATE|MAP_ANON, -1, 0);
+	if (private == MAP_FAILED) {
+		err(1, "mmap (private)");
+	}
+	if (shared[0] != 0 || private[0] != 0) {
+		errx(1, "Anonymous memory isn't zero-filled");
+	}
+	shared[0] = 1;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		if (shared[0] != 1) {
+			/* _exit: don't flush stdio copied from the parent */
+			warnx("Child doesn't see the parent's write");
+			_exit(1);
+		}
+		shared[1] = MAGIC;
+		private[0] = MAGIC;
+		_exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFSIGNALED(status)) {
+		errx(1, "pid %d: signal %d", pid, WTERMSIG(status));
+	}
+	if (WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d: exit %d", pid, WEXITSTATUS(status));
+	}
+
+	if (shared[1] != MAGIC) {
+		errx(1, "Child's write to shared memory not seen");
+	}
+	if (private[0] != 0) {
+		errx(1, "Child's write to private memory leaked through");
+	}
+
+	printf("Passed shmtest.\n");
+	return 0;
+}
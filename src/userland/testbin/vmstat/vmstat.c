@@ -0,0 +1,42 @@
+/*
+ * vmstat - print the VM statistics.
+ *
+ * The event counters count since boot, so run it before and after
+ * something else to see what that did to the VM system.
+ */
+
+#include <sys/types.h>
+#include <sys/vmstat.h>
+#include <stdio.h>
+#include <err.h>
+
+static
+void
+printall(const struct vmstat *vs)
+{
+	printf("Memory: %u frames of %u bytes, %u free (fewest %u)\n",
+	       vs->vs_frames, vs->vs_pagesize, vs->vs_free, vs->vs_minfree);
+	printf("Swap:   %u slots, %u used\n",
+	       vs->vs_swapslots, vs->vs_swapused);
+	printf("Faults: %u read, %u write, %u read-only, %u refilled\n",
+	       vs->vs_readfaults, vs->vs_writefaults, vs->vs_rofaults,
+	       vs->vs_refills);
+	printf("Pages:  %u zero-filled, %u copied, %u read from files, "
+	       "%u paged in, %u paged out\n",
+	       vs->vs_zerofills, vs->vs_cowcopies, vs->vs_filereads,
+	       vs->vs_pageins, vs->vs_pageouts);
+	printf("Me:     %u faults, %u resident, %u swapped\n",
+	       vs->vs_myfaults, vs->vs_myresident, vs->vs_myswapped);
+}
+
+int
+main(void)
+{
+	struct vmstat vs;
+
+	if (vmstat(&vs) < 0) {
+		err(1, "vmstat");
+	}
+	printall(&vs);
+	return 0;
+}